@@ -0,0 +1,109 @@
+#include "IcsAngleConverter.hpp"
+
+// コンストラクタ
+// 全ジョイント、オフセット無し・正転・POS_MIN-POS_MAX のリミットで初期化
+IcsAngleConverter::IcsAngleConverter() {}
+
+// ジョイントのキャリブレーション設定
+// 変換ループ内で分岐しないよう、リバースは係数の符号に含めておく
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsAngleConverter::set_joint(uint8_t servolocalID, int offset,
+                                 bool reverse, int low, int high) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((low < POS_MIN) || (high > POS_MAX) || (low > high)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if (((POS_CENTER + offset) < low) || ((POS_CENTER + offset) > high)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsJointCoef *c = &coef[servolocalID];
+  c->gain = reverse ? -ICS_COUNT_PER_RAD_Q16 : ICS_COUNT_PER_RAD_Q16;
+  c->invgain = reverse ? -ICS_RAD_PER_COUNT_Q32 : ICS_RAD_PER_COUNT_Q32;
+  c->center = POS_CENTER + offset;
+  c->low = low;
+  c->high = high;
+
+  return RETCODE_OK;
+}
+
+// EEPROMの上下リミットを、クランプ用リミットとして取り込む
+// EEPROMのオフセット・リバースはサーボ内部で処理されるので、ここでは扱わない。
+// EEPROM_NOTCHANGE の項目は変更しない。
+int IcsAngleConverter::set_limit_from_EEPROM(uint8_t servolocalID,
+                                             EEPROMdata *edata) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsJointCoef *c = &coef[servolocalID];
+  int low = c->low;
+  int high = c->high;
+  if (edata->poslimitlow != EEPROM_NOTCHANGE) {
+    low = edata->poslimitlow;
+  }
+  if (edata->poslimithigh != EEPROM_NOTCHANGE) {
+    high = edata->poslimithigh;
+  }
+  if ((low < POS_MIN) || (high > POS_MAX) || (low > high)) {
+    return RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  c->low = low;
+  c->high = high;
+  return RETCODE_OK;
+}
+
+// 角度→ポジション一括変換
+// Q16.16[rad] × Q16.16[count/rad] = Q32 なので、丸めて32bitシフトする
+int IcsAngleConverter::to_position(const int32_t *rad_q16, int *pos, int num) {
+  int clampnum = 0;
+
+  if (num > ID_NUM) {
+    num = ID_NUM;
+  }
+
+  for (int a = 0; a < num; a++) {
+    const IcsJointCoef *c = &coef[a];
+    int32_t val =
+        c->center +
+        (int32_t)(((int64_t)rad_q16[a] * c->gain + 0x80000000LL) >> 32);
+
+    if (val < c->low) {
+      val = c->low;
+      clampnum++;
+    } else if (val > c->high) {
+      val = c->high;
+      clampnum++;
+    }
+    pos[a] = val;
+  }
+
+  return clampnum;
+}
+
+// ポジション→角度一括変換
+// カウント × Q0.32[rad/count] = Q32 なので、16bitシフトで Q16.16 にする
+int IcsAngleConverter::to_angle(const int *pos, int32_t *rad_q16, int num) {
+  if (num > ID_NUM) {
+    num = ID_NUM;
+  }
+
+  for (int a = 0; a < num; a++) {
+    const IcsJointCoef *c = &coef[a];
+    if (pos[a] < 0) {
+      // set_position等のエラーコード
+      rad_q16[a] = 0;
+      continue;
+    }
+    rad_q16[a] = (int32_t)(((int64_t)(pos[a] - c->center) * c->invgain +
+                            0x8000) >>
+                           16);
+  }
+
+  return RETCODE_OK;
+}
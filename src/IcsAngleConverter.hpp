@@ -0,0 +1,55 @@
+#ifndef _ICS_ANGLE_CONVERTER_HPP_
+#define _ICS_ANGLE_CONVERTER_HPP_
+
+#include "IcsDefine.hpp"
+#include "stdint.h"
+
+// 角度（ラジアン）とICSポジション値（3500-11500）の一括変換
+// FPUの無いマイコン（Cortex-M3等）向けに、固定小数点のみで計算する。
+// 角度は Q16.16 形式（1.0rad = 65536）で扱う。
+// ポジション配列、角度配列ともにサーボIDを添字とする。
+
+// Q16.16 固定小数点の 1.0
+static const int32_t ICS_Q16_ONE = 65536;
+
+// ICSサーボの可動範囲 270度 = 8000カウント より、
+// 1radあたり 16000/(3π) = 1697.65 カウント
+static const int32_t ICS_COUNT_PER_RAD_Q16 = 111257369; // Q16.16
+static const int32_t ICS_RAD_PER_COUNT_Q32 = 2529945;   // Q0.32
+
+// ジョイントごとの変換係数（set_joint時に前計算しておく）
+struct IcsJointCoef
+{
+  int32_t gain = ICS_COUNT_PER_RAD_Q16;    // カウント/rad（リバース時は負）
+  int32_t invgain = ICS_RAD_PER_COUNT_Q32; // rad/カウント（リバース時は負）
+  int32_t center = POS_CENTER;             // 0radのときのポジション値
+  int32_t low = POS_MIN;                   // 下限リミット
+  int32_t high = POS_MAX;                  // 上限リミット
+};
+
+class IcsAngleConverter
+{
+  // プライベート変数
+private:
+  IcsJointCoef coef[ID_NUM];
+
+  // パブリック関数
+public:
+  IcsAngleConverter();
+
+  // キャリブレーション設定
+  // offset: 0rad とみなすポジションのずれ（カウント）
+  // reverse: 回転方向を反転するか
+  // low, high: リミット（POS_MIN-POS_MAX の範囲内）
+  int set_joint(uint8_t servolocalID, int offset, bool reverse,
+                int low = POS_MIN, int high = POS_MAX);
+  int set_limit_from_EEPROM(uint8_t servolocalID, EEPROMdata *edata);
+
+  // 一括変換　ID 0 から num-1 まで
+  // 角度→ポジション　戻り値はリミットでクランプしたジョイント数
+  int to_position(const int32_t *rad_q16, int *pos, int num);
+  // ポジション→角度　エラーコード（負の値）のポジションは変換せず 0rad とする
+  int to_angle(const int *pos, int32_t *rad_q16, int num);
+};
+
+#endif
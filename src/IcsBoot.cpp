@@ -0,0 +1,175 @@
+#include "IcsBoot.hpp"
+#include "stddef.h"
+#include "string.h"
+
+// コンストラクタ
+IcsBoot::IcsBoot() {
+  for (int a = 0; a < BUS_MAX; a++) {
+    bus[a] = nullptr;
+    record[a] = nullptr;
+  }
+}
+
+// バスの登録
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsBoot::add_bus(IcsCommunication &ics, const IcsFleetRecord *rec) {
+  // 引数チェック
+  if (busNum >= BUS_MAX) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  bus[busNum] = &ics;
+  record[busNum] = rec;
+  busNum++;
+  return RETCODE_OK;
+}
+
+// 全バスの初期化
+// 戻り値に ICS_BOOT_PULSE（ウェイトを行った）か ICS_BOOT_SKIP（省略した）が入ります。
+int IcsBoot::start(uint32_t brate, int mode) {
+  timing = IcsBootTiming();
+  timing.startTime = us_ticker_read();
+
+  bool skip = (mode == ICS_BOOT_SKIP) || ((mode == ICS_BOOT_AUTO) && can_skip());
+
+  if (skip) {
+    IcsCommunication::begin_parallel(bus, busNum, brate, false);
+    if (mode == ICS_BOOT_AUTO) {
+      uint32_t t0 = us_ticker_read();
+      timing.verifyFail = verify();
+      timing.verifyUs = us_ticker_read() - t0;
+      // 返信の無いサーボがいれば、ウェイトをやり直す
+      skip = (timing.verifyFail == 0);
+    }
+  }
+
+  if (!skip) {
+    uint32_t t0 = us_ticker_read();
+    IcsCommunication::begin_parallel(bus, busNum, brate, true);
+    timing.pulseUs = us_ticker_read() - t0;
+    timing.pulsed = true;
+  }
+
+  timing.readyTime = us_ticker_read();
+  return skip ? ICS_BOOT_SKIP : ICS_BOOT_PULSE;
+}
+
+// 最初の動作指令の記録　2回目以降は無視
+void IcsBoot::mark_first_motion() {
+  if (timing.firstMotionTime == 0) {
+    timing.firstMotionTime = us_ticker_read();
+  }
+}
+
+const IcsBootTiming *IcsBoot::get_timing() { return &timing; }
+
+// 起動時間の内訳表示（msec）
+void IcsBoot::show_timing() {
+  printf("ICS boot timing [ms]\r\n");
+  printf("  reset -> start      : %lu\r\n",
+         (unsigned long)(timing.startTime / 1000));
+  printf("  init pulse          : %lu%s\r\n",
+         (unsigned long)(timing.pulseUs / 1000),
+         timing.pulsed ? "" : " (skipped)");
+  printf("  verify              : %lu (no reply: %d)\r\n",
+         (unsigned long)(timing.verifyUs / 1000), timing.verifyFail);
+  printf("  start -> ready      : %lu\r\n",
+         (unsigned long)((timing.readyTime - timing.startTime) / 1000));
+  if (timing.firstMotionTime != 0) {
+    printf("  ready -> 1st motion : %lu\r\n",
+           (unsigned long)((timing.firstMotionTime - timing.readyTime) / 1000));
+    printf("  reset -> 1st motion : %lu\r\n",
+           (unsigned long)(timing.firstMotionTime / 1000));
+  }
+}
+
+// 構成記録の作成　idmask の各IDのEEPROMを読み取って記録する
+// begin 済みのバスで呼ぶこと。
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsBoot::capture_record(IcsCommunication &ics, uint32_t idmask,
+                            IcsFleetRecord *rec) {
+  // チェックサムが詰め物のバイトに左右されないよう、全体をゼロにしてから作る
+  memset((void *)rec, 0, sizeof(IcsFleetRecord));
+
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if (((idmask >> id) & 1) == 0) {
+      continue;
+    }
+    int tmpretcode = ics.get_EEPROM(id, &rec->cfg[id]);
+    if (tmpretcode != RETCODE_OK) {
+      rec->magic = 0;
+      return tmpretcode;
+    }
+  }
+
+  rec->idmask = idmask;
+  rec->magic = RECORD_MAGIC;
+  rec->checksum = calc_checksum(rec);
+  return RETCODE_OK;
+}
+
+// 構成記録の有効確認（フラッシュ等から読み出した直後の確認用）
+bool IcsBoot::check_record(const IcsFleetRecord *rec) {
+  if ((rec == nullptr) || (rec->magic != RECORD_MAGIC)) {
+    return false;
+  }
+  return rec->checksum == calc_checksum(rec);
+}
+
+// 記録の全サーボにPWMINHフラグが立っているか
+bool IcsBoot::record_pwminh_all(const IcsFleetRecord *rec) {
+  if (!check_record(rec) || (rec->idmask == 0)) {
+    return false;
+  }
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if (((rec->idmask >> id) & 1) == 0) {
+      continue;
+    }
+    if (ics_packed_get(&rec->cfg[id], ICS_FIELD_FLAG_PWMINH) != 1) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// FNV-1a（checksum 自身は除く）
+uint32_t IcsBoot::calc_checksum(const IcsFleetRecord *rec) {
+  const uint8_t *p = (const uint8_t *)rec;
+  uint32_t hash = 2166136261UL;
+
+  for (size_t a = 0; a < offsetof(IcsFleetRecord, checksum); a++) {
+    hash = (hash ^ p[a]) * 16777619UL;
+  }
+  return hash;
+}
+
+// 全バスの記録が揃っていて、全サーボ PWMINH なら省略できる
+bool IcsBoot::can_skip() {
+  if (busNum == 0) {
+    return false;
+  }
+  for (int b = 0; b < busNum; b++) {
+    if (!record_pwminh_all(record[b])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 記録の全サーボに1回ずつ読み取りを行う
+// 戻り値に返信の無かったサーボ数が入ります。
+int IcsBoot::verify() {
+  int failnum = 0;
+
+  for (int b = 0; b < busNum; b++) {
+    for (int id = ID_MIN; id <= ID_MAX; id++) {
+      if (((record[b]->idmask >> id) & 1) == 0) {
+        continue;
+      }
+      if (bus[b]->get_stretch(id) < 0) {
+        failnum++;
+      }
+    }
+  }
+  return failnum;
+}
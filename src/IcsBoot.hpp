@@ -0,0 +1,88 @@
+#ifndef _ICS_BOOT_HPP_
+#define _ICS_BOOT_HPP_
+
+#include "IcsCommunication.hpp"
+#include "IcsPackedConfig.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// 起動処理の短縮と起動時間の計測
+// begin() の550msecウェイト（信号線High）は、サーボをシリアル通信モードにする手続き。
+// ・複数バスのウェイトを同時に1回で行う（ICS_BOOT_PULSE）
+// ・前回保存したサーボ構成記録（IcsFleetRecord）で、全サーボのEEPROMに
+//   PWMINHフラグが立っていればウェイトを省略する（ICS_BOOT_AUTO）
+//   省略後に記録の全サーボへ読み取りを行い、返信の無いサーボがいれば
+//   ウェイトをやり直す（サーボ交換などで記録が古くなった場合の保険）。
+// ・各段階の時刻を記録し、リセットから最初の動作までの内訳を表示する。
+//
+// 構成記録はRAM上の構造体なので、フラッシュ等への保存・読み出しは利用側で行う。
+
+// 起動モード
+static const int ICS_BOOT_PULSE = 0; // 常にウェイトを行う（全バス同時）
+static const int ICS_BOOT_AUTO = 1;  // 構成記録で判断し、可能なら省略
+static const int ICS_BOOT_SKIP = 2;  // 常に省略（全サーボ PWMINH 設定済みの機体）
+
+// サーボ構成記録（バス1本分）
+struct IcsFleetRecord
+{
+  uint32_t magic;  // RECORD_MAGIC なら有効
+  uint32_t idmask; // 接続されているID（1 << ID）
+  IcsPackedConfig cfg[ID_NUM];
+  uint32_t checksum;
+};
+
+// 起動時間の内訳（時刻は us_ticker_read の値＝リセットからの経過 usec）
+struct IcsBootTiming
+{
+  uint32_t startTime = 0;       // start() 呼び出し時刻
+  uint32_t pulseUs = 0;         // ウェイト（信号線High）の時間
+  uint32_t verifyUs = 0;        // 省略時の確認読み取りの時間
+  uint32_t readyTime = 0;       // start() 完了時刻
+  uint32_t firstMotionTime = 0; // 最初の動作指令時刻（0は未記録）
+  bool pulsed = false;          // ウェイトを行ったか
+  int verifyFail = 0;           // 確認読み取りで返信の無かったサーボ数
+};
+
+class IcsBoot
+{
+  // パブリック変数
+public:
+  static const int BUS_MAX = 4;
+  static const uint32_t RECORD_MAGIC = 0x49435346; // "ICSF"
+
+  // プライベート変数
+private:
+  IcsCommunication *bus[BUS_MAX];
+  const IcsFleetRecord *record[BUS_MAX];
+  int busNum = 0;
+  IcsBootTiming timing;
+
+  // パブリック関数
+public:
+  IcsBoot();
+
+  // バスの登録　構成記録が無ければ nullptr
+  int add_bus(IcsCommunication &ics, const IcsFleetRecord *rec = nullptr);
+
+  // 全バスの初期化　戻り値に ICS_BOOT_PULSE（ウェイト実施）か ICS_BOOT_SKIP（省略）
+  int start(uint32_t brate = 115200, int mode = ICS_BOOT_AUTO);
+
+  // 最初の動作指令の直前に呼ぶ（起動時間の記録用）
+  void mark_first_motion();
+  const IcsBootTiming *get_timing();
+  void show_timing();
+
+  // 構成記録
+  static int capture_record(IcsCommunication &ics, uint32_t idmask,
+                            IcsFleetRecord *rec);
+  static bool check_record(const IcsFleetRecord *rec);
+  static bool record_pwminh_all(const IcsFleetRecord *rec);
+
+  // プライベート関数
+private:
+  static uint32_t calc_checksum(const IcsFleetRecord *rec);
+  bool can_skip();
+  int verify();
+};
+
+#endif
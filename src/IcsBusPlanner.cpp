@@ -0,0 +1,116 @@
+#include "IcsBusPlanner.hpp"
+
+// コンストラクタ
+// 引数：　ボーレート、EEPROM書き込み完了までの時間（usec）
+IcsBusPlanner::IcsBusPlanner(uint32_t brate, uint32_t eeprom_write_us)
+    : baudrate(brate), eepromWriteUs(eeprom_write_us) {}
+
+// ボーレート設定　IcsCommunication::get_baudrate() の値を渡す
+void IcsBusPlanner::set_baudrate(uint32_t brate) { baudrate = brate; }
+
+// タイミング設定
+// 引数：　ターンアラウンド時間、サーボ返信待ち時間、ホスト処理時間（usec）
+void IcsBusPlanner::set_timing(uint32_t turnaround_us, uint32_t response_us,
+                               uint32_t overhead_us) {
+  turnaroundUs = turnaround_us;
+  responseUs = response_us;
+  overheadUs = overhead_us;
+}
+
+// EEPROM書き込み完了までの時間（usec）
+// サーボはEEPROMへの書き込みを終えてから返信するので、返信待ち時間に加算する。
+void IcsBusPlanner::set_eeprom_write_us(uint32_t eeprom_write_us) {
+  eepromWriteUs = eeprom_write_us;
+}
+
+// 1文字(11bit)の送信時間（nsec）
+uint32_t IcsBusPlanner::char_ns() {
+  if (baudrate == 0) {
+    return 0;
+  }
+  return (uint32_t)(((uint64_t)BITS_PER_CHAR * 1000000000ULL + baudrate - 1) /
+                    baudrate);
+}
+
+// 任意の送受信バイト数での1往復時間（usec、切り上げ）
+uint32_t IcsBusPlanner::transaction_us(int txsize, int rxsize) {
+  uint32_t wire_ns = char_ns() * (uint32_t)(txsize + rxsize);
+  return (wire_ns + 999) / 1000 + turnaroundUs + responseUs + overheadUs;
+}
+
+// コマンド種別ごとの1往復時間（usec）
+// 戻り値に時間、または不正なコマンド種別の場合 0 が入ります。
+uint32_t IcsBusPlanner::command_us(int cmd) {
+  if ((cmd < 0) || (cmd >= ICS_CMD_NUM)) {
+    return 0;
+  }
+  uint32_t us = transaction_us(ICS_CMD_TXSIZE[cmd], ICS_CMD_RXSIZE[cmd]);
+  if (cmd == ICS_CMD_WRITEEEPROM) {
+    // 返信は書き込み完了後
+    us += eepromWriteUs;
+  }
+  return us;
+}
+
+// 計画をクリア
+void IcsBusPlanner::clear() { plannum = 0; }
+
+// 計画にコマンドを追加
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsBusPlanner::add(int cmd, int count) {
+  if ((cmd < 0) || (cmd >= ICS_CMD_NUM) || (count < 0)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  // 同じ種別があればまとめる
+  for (int a = 0; a < plannum; a++) {
+    if (plan[a].cmd == cmd) {
+      plan[a].count += count;
+      return RETCODE_OK;
+    }
+  }
+
+  if (plannum >= PLAN_MAX) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  plan[plannum].cmd = cmd;
+  plan[plannum].count = count;
+  plannum++;
+  return RETCODE_OK;
+}
+
+// 計画全体のバス占有時間（usec）
+uint32_t IcsBusPlanner::total_us() {
+  uint32_t total = 0;
+  for (int a = 0; a < plannum; a++) {
+    total += command_us(plan[a].cmd) * plan[a].count;
+  }
+  return total;
+}
+
+// 計画が制御周期内に収まるかの判定
+// 戻り値にRETCODE_OK（1の値）、または RETCODE_ERROR_BUSOVERRUN が入ります。
+int IcsBusPlanner::check(uint32_t period_us) {
+  if (total_us() > period_us) {
+    return RETCODE_ERROR_BUSOVERRUN;
+  }
+  return RETCODE_OK;
+}
+
+// 計画を実行した後に残るバス時間（usec）　収まらない場合は 0
+uint32_t IcsBusPlanner::spare_us(uint32_t period_us) {
+  uint32_t total = total_us();
+  if (total >= period_us) {
+    return 0;
+  }
+  return period_us - total;
+}
+
+// 残りのバス時間に入るテレメトリ（既定はパラメータ読み取り）の回数
+int IcsBusPlanner::telemetry_capacity(uint32_t period_us, int cmd) {
+  uint32_t one = command_us(cmd);
+  if (one == 0) {
+    return 0;
+  }
+  return spare_us(period_us) / one;
+}
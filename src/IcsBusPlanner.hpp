@@ -0,0 +1,70 @@
+#ifndef _ICS_BUS_PLANNER_HPP_
+#define _ICS_BUS_PLANNER_HPP_
+
+#include "IcsCodec.hpp"
+#include "IcsDefine.hpp"
+#include "stdint.h"
+
+// ICSバスの時間見積もり・制御周期内に収まるかの判定
+// 各コマンドの送受信バイト数から、1往復にかかるバス占有時間を計算する。
+//  1文字 = スタート1 + データ8 + パリティ1 + ストップ1 = 11bit (8E1)
+//  1線式なので送信バイトはエコーとして同時に受信される（バス時間は増えない）。
+//  送信後の方向切替（ターンアラウンド）、サーボの返信待ち、
+//  ホスト側の処理時間（エコー空読み等）は別途パラメータとして加算する。
+//  EEPROM書き込みは、サーボが書き込みを終えてから返信するので、さらに
+//  書き込み完了時間を加算する（既定は IcsCommunication のEEPROM書き込み
+//  タイムアウトと同じ 1秒。実測値があれば set_eeprom_write_us で設定する）。
+
+static const int RETCODE_ERROR_BUSOVERRUN = -1007; // 周期内に収まらない
+
+class IcsBusPlanner
+{
+  // パブリック変数
+public:
+  static const int BITS_PER_CHAR = 11; // 8E1
+  static const int PLAN_MAX = 16;      // 登録できるコマンド種別の行数
+  static const uint32_t EEPROM_WRITE_US_DEFAULT = 1000000;
+
+  // プライベート変数
+private:
+  struct PlanEntry
+  {
+    uint8_t cmd;
+    uint16_t count;
+  };
+
+  uint32_t baudrate = 115200;
+  uint32_t turnaroundUs = 10; // 送信完了→受信切替
+  uint32_t responseUs = 100;  // コマンド受信完了→サーボ返信開始
+  uint32_t overheadUs = 20;   // ホスト側の処理時間（1往復あたり）
+  uint32_t eepromWriteUs;     // EEPROM書き込み完了までの時間
+
+  PlanEntry plan[PLAN_MAX];
+  int plannum = 0;
+
+  // パブリック関数
+public:
+  IcsBusPlanner(uint32_t brate = 115200,
+                uint32_t eeprom_write_us = EEPROM_WRITE_US_DEFAULT);
+
+  // タイミング設定
+  void set_baudrate(uint32_t brate);
+  void set_timing(uint32_t turnaround_us, uint32_t response_us,
+                  uint32_t overhead_us);
+  void set_eeprom_write_us(uint32_t eeprom_write_us);
+
+  // 1往復あたりの時間（usec）
+  uint32_t char_ns();
+  uint32_t command_us(int cmd);
+  uint32_t transaction_us(int txsize, int rxsize);
+
+  // 制御周期の計画
+  void clear();
+  int add(int cmd, int count = 1);
+  uint32_t total_us();
+  int check(uint32_t period_us);
+  uint32_t spare_us(uint32_t period_us);
+  int telemetry_capacity(uint32_t period_us, int cmd = ICS_CMD_READPARAM);
+};
+
+#endif
@@ -0,0 +1,482 @@
+#include "IcsCodec.hpp"
+#include "stdio.h"
+
+// 上位下位4bitずつに分かれた2byteを、1byteにして取得する関数
+uint8_t ics_combine_2byte(uint8_t a, uint8_t b) {
+  return (uint8_t)((a << 4) | b);
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// ポジション、パラメータ
+
+// ポジション送信データ作成（val = 0 で脱力）
+// 戻り値に送信バイト数が入ります。
+int ics_encode_position(uint8_t *txbuf, uint8_t servolocalID, int val) {
+  txbuf[0] = ICS_CMD_HEAD_POSITION | servolocalID;
+  txbuf[1] = val >> 7;
+  txbuf[2] = val & 0b0000000001111111;
+  return 3;
+}
+
+// ポジション返信データ確認
+// 戻り値に現在位置、またはエラーコード（負の値）が入ります。
+int ics_decode_position(const uint8_t *rxbuf, uint8_t servolocalID) {
+  if ((rxbuf[0] & 0b01111111) == servolocalID) {
+    return (rxbuf[1] << 7) + (rxbuf[2]);
+  }
+  return RETCODE_ERROR_IDWRONG;
+}
+
+// パラメータ読み取り送信データ作成
+int ics_encode_read_param(uint8_t *txbuf, uint8_t servolocalID,
+                          uint8_t sccode) {
+  txbuf[0] = ICS_CMD_HEAD_READ | servolocalID;
+  txbuf[1] = sccode;
+  return 2;
+}
+
+// パラメータ読み取り返信データ確認　バッファチェック　ID, SC
+// 戻り値にパラメータ値、またはエラーコード（負の値）が入ります。
+int ics_decode_read_param(const uint8_t *rxbuf, uint8_t servolocalID,
+                          uint8_t sccode) {
+  if ((rxbuf[0] == (0x20 | servolocalID)) && (rxbuf[1] == sccode)) {
+    return rxbuf[2];
+  }
+  return RETCODE_ERROR_RETURNDATAWRONG;
+}
+
+// パラメータ書き込み送信データ作成
+int ics_encode_write_param(uint8_t *txbuf, uint8_t servolocalID,
+                           uint8_t sccode, int val) {
+  txbuf[0] = ICS_CMD_HEAD_WRITE | servolocalID;
+  txbuf[1] = sccode;
+  txbuf[2] = val;
+  return 3;
+}
+
+// パラメータ書き込み返信データ確認　バッファチェック　ID, SC
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int ics_decode_write_param(const uint8_t *rxbuf, uint8_t servolocalID,
+                           uint8_t sccode) {
+  if ((rxbuf[0] == (0x40 | servolocalID)) && (rxbuf[1] == sccode)) {
+    return RETCODE_OK;
+  }
+  return RETCODE_ERROR_RETURNDATAWRONG;
+}
+
+// ICS3.6 現在位置取得の返信データ確認　バッファチェック　ID, SC
+// 戻り値に現在位置、またはエラーコード（負の値）が入ります。
+int ics_decode_read_position(const uint8_t *rxbuf, uint8_t servolocalID) {
+  if ((rxbuf[0] == (0x20 | servolocalID)) && (rxbuf[1] == ICS_SC_POSITION)) {
+    return (rxbuf[2] << 7) + (rxbuf[3]);
+  }
+  return RETCODE_ERROR_RETURNDATAWRONG;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// EEPROM系
+
+// EEPROM読み取り返信の先頭確認　バッファチェック　ID, SC, 0x5A
+int ics_check_EEPROM_header(const uint8_t *rxbuf, uint8_t servolocalID) {
+  if ((rxbuf[0] != (0x20 | servolocalID)) || (rxbuf[1] != ICS_SC_EEPROM) ||
+      (rxbuf[2] != 0x5) || (rxbuf[3] != 0xA)) {
+    return RETCODE_ERROR_RETURNDATAWRONG;
+  }
+  return RETCODE_OK;
+}
+
+// EEPROM生バイト(66byte)から、EEPROMデータ構造体へ変換
+void ics_decode_EEPROM(const uint8_t *rxbuf, EEPROMdata *r_edata) {
+  r_edata->stretch =
+      ics_combine_2byte(rxbuf[4], rxbuf[5]) / 2; // 2倍値で収納されてる
+  r_edata->speed = ics_combine_2byte(rxbuf[6], rxbuf[7]);
+  r_edata->punch = ics_combine_2byte(rxbuf[8], rxbuf[9]);
+  r_edata->deadband = ics_combine_2byte(rxbuf[10], rxbuf[11]);
+  r_edata->dumping = ics_combine_2byte(rxbuf[12], rxbuf[13]);
+  r_edata->safetimer = ics_combine_2byte(rxbuf[14], rxbuf[15]);
+
+  r_edata->flag_slave = (rxbuf[16] >> 3) & 0b00000001;
+  r_edata->flag_rotation = (rxbuf[16]) & 0b00000001;
+  r_edata->flag_pwminh = (rxbuf[17] >> 3) & 0b00000001;
+  r_edata->flag_free = (rxbuf[17] >> 1) & 0b00000001;
+  r_edata->flag_reverse = (rxbuf[17]) & 0b00000001;
+
+  r_edata->poslimithigh = (ics_combine_2byte(rxbuf[18], rxbuf[19]) << 8) |
+                          ics_combine_2byte(rxbuf[20], rxbuf[21]);
+  r_edata->poslimitlow = (ics_combine_2byte(rxbuf[22], rxbuf[23]) << 8) |
+                         ics_combine_2byte(rxbuf[24], rxbuf[25]);
+
+  int commflagval = ics_combine_2byte(rxbuf[28], rxbuf[29]);
+  if (commflagval == 0x00) {
+    r_edata->commspeed = 1250000;
+  } else if (commflagval == 0x01) {
+    r_edata->commspeed = 625000;
+  } else if (commflagval == 0x0A) {
+    r_edata->commspeed = 115200;
+  } else {
+    r_edata->commspeed = EEPROM_NOTCHANGE;
+  }
+
+  r_edata->temperaturelimit = ics_combine_2byte(rxbuf[30], rxbuf[31]);
+  r_edata->currentlimit = ics_combine_2byte(rxbuf[32], rxbuf[33]);
+  r_edata->response = ics_combine_2byte(rxbuf[52], rxbuf[53]);
+
+  uint8_t tmpoffset = ics_combine_2byte(rxbuf[54], rxbuf[55]);
+  // ICSマネージャ挙動では、正負反対に収納されているのでそれに合わせる
+  if ((tmpoffset >> 7) == 0b00000001) { // 負ビット
+    r_edata->offset = ((~(tmpoffset)&0b01111111) + 1);
+  } else { // 正ビット
+    r_edata->offset = 0 - tmpoffset;
+  }
+
+  r_edata->ID = ics_combine_2byte(rxbuf[58], rxbuf[59]);
+
+  r_edata->charstretch1 =
+      ics_combine_2byte(rxbuf[60], rxbuf[61]) / 2; // 2倍値で収納されてる
+  r_edata->charstretch2 =
+      ics_combine_2byte(rxbuf[62], rxbuf[63]) / 2; // 2倍値で収納されてる
+  r_edata->charstretch3 =
+      ics_combine_2byte(rxbuf[64], rxbuf[65]) / 2; // 2倍値で収納されてる
+}
+
+// EEPROMデータ構造体のうち EEPROM_NOTCHANGE でない項目を、送信バッファへ反映
+// txbuf には事前に読み取った元のEEPROM生バイトを入れておくこと。
+void ics_encode_EEPROM(uint8_t *txbuf, EEPROMdata *w_edata) {
+  if (w_edata->stretch != EEPROM_NOTCHANGE) {
+    txbuf[4] =
+        (uint8_t)(w_edata->stretch * 2) >> 4; // 2倍値で収納されてるので処理
+    txbuf[5] = (uint8_t)(w_edata->stretch * 2) & 0b0000000000001111;
+  }
+
+  if (w_edata->speed != EEPROM_NOTCHANGE) {
+    txbuf[6] = (uint8_t)(w_edata->speed) >> 4;
+    txbuf[7] = (uint8_t)(w_edata->speed) & 0b0000000000001111;
+  }
+  if (w_edata->punch != EEPROM_NOTCHANGE) {
+    txbuf[8] = (uint8_t)(w_edata->punch) >> 4;
+    txbuf[9] = (uint8_t)(w_edata->punch) & 0b0000000000001111;
+  }
+  if (w_edata->deadband != EEPROM_NOTCHANGE) {
+    txbuf[10] = (uint8_t)(w_edata->deadband) >> 4;
+    txbuf[11] = (uint8_t)(w_edata->deadband) & 0b0000000000001111;
+  }
+  if (w_edata->dumping != EEPROM_NOTCHANGE) {
+    txbuf[12] = (uint8_t)(w_edata->dumping) >> 4;
+    txbuf[13] = (uint8_t)(w_edata->dumping) & 0b0000000000001111;
+  }
+  if (w_edata->safetimer != EEPROM_NOTCHANGE) {
+    txbuf[14] = (uint8_t)(w_edata->safetimer) >> 4;
+    txbuf[15] = (uint8_t)(w_edata->safetimer) & 0b0000000000001111;
+  }
+
+  if (w_edata->flag_slave != EEPROM_NOTCHANGE) {
+    if (w_edata->flag_slave == 1) {
+      txbuf[16] = txbuf[16] | 0b00001000;
+    }
+    if (w_edata->flag_slave == 0) {
+      txbuf[16] = txbuf[16] & 0b11110111;
+    }
+  }
+  if (w_edata->flag_rotation != EEPROM_NOTCHANGE) {
+    if (w_edata->flag_rotation == 1) {
+      txbuf[16] = txbuf[16] | 0b00000001;
+    }
+    if (w_edata->flag_rotation == 0) {
+      txbuf[16] = txbuf[16] & 0b11111110;
+    }
+  }
+  if (w_edata->flag_pwminh != EEPROM_NOTCHANGE) {
+    if (w_edata->flag_pwminh == 1) {
+      txbuf[17] = txbuf[17] | 0b00001000;
+    }
+    if (w_edata->flag_pwminh == 0) {
+      txbuf[17] = txbuf[17] & 0b11110111;
+    }
+  }
+  if (w_edata->flag_free != EEPROM_NOTCHANGE) {
+    // freeフラグは参照のみとのこと。ここを書き込む事は、マニュアル等に説明は無いので挙動不明
+    // if (w_edata->flag_free == 1) { txbuf[17] = txbuf[17] | 0b00000010 ; }
+    // if (w_edata->flag_free == 0) { txbuf[17] = txbuf[17] & 0b11111101 ; }
+  }
+  if (w_edata->flag_reverse != EEPROM_NOTCHANGE) {
+    if (w_edata->flag_reverse == 1) {
+      txbuf[17] = txbuf[17] | 0b00000001;
+    }
+    if (w_edata->flag_reverse == 0) {
+      txbuf[17] = txbuf[17] & 0b11111110;
+    }
+  }
+
+  if (w_edata->poslimithigh != EEPROM_NOTCHANGE) {
+    txbuf[18] =
+        (w_edata->poslimithigh >> 12) & 0b00000000000000000000000000001111;
+    txbuf[19] =
+        (w_edata->poslimithigh >> 8) & 0b00000000000000000000000000001111;
+    txbuf[20] =
+        (w_edata->poslimithigh >> 4) & 0b00000000000000000000000000001111;
+    txbuf[21] = (w_edata->poslimithigh) & 0b00000000000000000000000000001111;
+  }
+
+  if (w_edata->poslimitlow != EEPROM_NOTCHANGE) {
+    txbuf[22] =
+        (w_edata->poslimitlow >> 12) & 0b00000000000000000000000000001111;
+    txbuf[23] =
+        (w_edata->poslimitlow >> 8) & 0b00000000000000000000000000001111;
+    txbuf[24] =
+        (w_edata->poslimitlow >> 4) & 0b00000000000000000000000000001111;
+    txbuf[25] = (w_edata->poslimitlow) & 0b00000000000000000000000000001111;
+  }
+
+  if (w_edata->commspeed != EEPROM_NOTCHANGE) {
+    if (w_edata->commspeed == 115200) {
+      txbuf[28] = 0x0;
+      txbuf[29] = 0xA;
+    } else if (w_edata->commspeed == 625000) {
+      txbuf[28] = 0x0;
+      txbuf[29] = 0x1;
+    } else if (w_edata->commspeed == 1250000) {
+      txbuf[28] = 0x0;
+      txbuf[29] = 0x0;
+    }
+  }
+
+  if (w_edata->temperaturelimit != EEPROM_NOTCHANGE) {
+    txbuf[30] = (uint8_t)(w_edata->temperaturelimit) >> 4;
+    txbuf[31] = (uint8_t)(w_edata->temperaturelimit) & 0b0000000000001111;
+  }
+  if (w_edata->currentlimit != EEPROM_NOTCHANGE) {
+    txbuf[32] = (uint8_t)(w_edata->currentlimit) >> 4;
+    txbuf[33] = (uint8_t)(w_edata->currentlimit) & 0b0000000000001111;
+  }
+  if (w_edata->response != EEPROM_NOTCHANGE) {
+    txbuf[52] = (uint8_t)(w_edata->response) >> 4;
+    txbuf[53] = (uint8_t)(w_edata->response) & 0b0000000000001111;
+  }
+  if (w_edata->offset !=
+      EEPROM_NOTCHANGE) { // ICSマネージャ挙動では、正負反対に収納されているのでそれに合わせる
+    uint8_t tmpoffset = ~(w_edata->offset) + 1;
+    txbuf[54] = (uint8_t)(tmpoffset) >> 4;
+    txbuf[55] = (uint8_t)(tmpoffset)&0b0000000000001111;
+  }
+  if (w_edata->ID != EEPROM_NOTCHANGE) {
+    // IDは専用のコマンドがあるので、本来はそちらで行う。こちらから書き込んでも私の環境ではID書き換えできているが、リファレンスマニュアルには記載無し
+    txbuf[58] = (uint8_t)(w_edata->ID) >> 4;
+    txbuf[59] = (uint8_t)(w_edata->ID) & 0b0000000000001111;
+  }
+
+  if (w_edata->charstretch1 != EEPROM_NOTCHANGE) {
+    txbuf[60] = (uint8_t)(w_edata->charstretch1 * 2) >>
+                4; // 2倍値で収納されてるので処理
+    txbuf[61] = (uint8_t)(w_edata->charstretch1 * 2) & 0b0000000000001111;
+  }
+  if (w_edata->charstretch2 != EEPROM_NOTCHANGE) {
+    txbuf[62] = (uint8_t)(w_edata->charstretch2 * 2) >>
+                4; // 2倍値で収納されてるので処理
+    txbuf[63] = (uint8_t)(w_edata->charstretch2 * 2) & 0b0000000000001111;
+  }
+  if (w_edata->charstretch3 != EEPROM_NOTCHANGE) {
+    txbuf[64] = (uint8_t)(w_edata->charstretch3 * 2) >>
+                4; // 2倍値で収納されてるので処理
+    txbuf[65] = (uint8_t)(w_edata->charstretch3 * 2) & 0b0000000000001111;
+  }
+}
+
+// データがEEPROM用として正当かどうかを確認する関数
+// 元々のサーボ内の変更禁止バイト部分の読み込み等は別で行っている
+// 内容がEEPROM_NOTCHANGE（初期状態）だと、書き込み不適と判断しエラーを返す
+int ics_check_EEPROMdata(EEPROMdata *edata) {
+  int checkdata;
+  int tmpretcode = RETCODE_OK;
+
+  checkdata = edata->stretch;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 1) || (checkdata > 127))) {
+    printf("EEPROMdata error: stretch\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->speed;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0x7F))) {
+    printf("EEPROMdata error: speed\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->punch;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x00) || (checkdata > 0x0A))) {
+    printf("EEPROMdata error: punch\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->deadband;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x00) || (checkdata > 0x10))) {
+    printf("EEPROMdata error: deadband\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->dumping;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0xFF))) {
+    printf("EEPROMdata error: dumping\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->safetimer;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0xFF))) {
+    printf("EEPROMdata error: safetimer\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  // フラグ
+  if ((edata->flag_slave != EEPROM_NOTCHANGE) && (edata->flag_slave != 0) &&
+      (edata->flag_slave != 1)) {
+    printf("EEPROMdata error: flag_slave\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  if ((edata->flag_rotation != EEPROM_NOTCHANGE) &&
+      (edata->flag_rotation != 0) && (edata->flag_rotation != 1)) {
+    printf("EEPROMdata error: flag_rotation\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  if ((edata->flag_pwminh != EEPROM_NOTCHANGE) && (edata->flag_pwminh != 0) &&
+      (edata->flag_pwminh != 1)) {
+    printf("EEPROMdata error: flag_pwminh\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  if ((edata->flag_free != EEPROM_NOTCHANGE) && (edata->flag_free != 0) &&
+      (edata->flag_free != 1)) {
+    printf("EEPROMdata error: flag_free\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  if ((edata->flag_reverse != EEPROM_NOTCHANGE) && (edata->flag_reverse != 0) &&
+      (edata->flag_reverse != 1)) {
+    printf("EEPROMdata error: flag_reverse\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  checkdata = edata->poslimithigh;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 8000) || (checkdata > POS_MAX))) {
+    printf("EEPROMdata error: poslimithigh\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->poslimitlow;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < POS_MIN) || (checkdata > 7000))) {
+    printf("EEPROMdata error: poslimitlow\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  if ((edata->commspeed != EEPROM_NOTCHANGE) && (edata->commspeed != 115200) &&
+      (edata->commspeed != 625000) && (edata->commspeed != 1250000)) {
+    printf("EEPROMdata error: commspeed\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  checkdata = edata->temperaturelimit;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0x7F))) {
+    printf("EEPROMdata error: temperaturelimit\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->currentlimit;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0x3F))) {
+    printf("EEPROMdata error: currentlimit\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->response;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x01) || (checkdata > 0x05))) {
+    printf("EEPROMdata error: response\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  // -128 は正負反転して収納すると表せないので、-127 まで
+  checkdata = edata->offset;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < -127) || (checkdata > 127))) {
+    printf("EEPROMdata error: offset\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->ID;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 0x00) || (checkdata > 0x1F))) {
+    printf("EEPROMdata error: ID\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->charstretch1;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 1) || (checkdata > 127))) {
+    printf("EEPROMdata error: charstretch1\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->charstretch2;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 1) || (checkdata > 127))) {
+    printf("EEPROMdata error: charstretch2\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  checkdata = edata->charstretch3;
+  if ((checkdata != EEPROM_NOTCHANGE) &&
+      ((checkdata < 1) || (checkdata > 127))) {
+    printf("EEPROMdata error: charstretch3\r\n");
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  return tmpretcode;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// トレース解析用
+
+// 送信フレームの種別判定
+// 戻り値にRETCODE_OK（1の値）、または判定できない場合エラーコード（負の値）
+int ics_decode_frame(const uint8_t *txbuf, int txsize, IcsFrameInfo *info) {
+  info->cmd = ICS_CMD_NUM;
+  info->id = -1;
+  info->sc = -1;
+  info->value = -1;
+
+  if (txsize < 1) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  uint8_t head = txbuf[0] & 0b11100000;
+  uint8_t id = txbuf[0] & 0b00011111;
+
+  if ((head == ICS_CMD_HEAD_POSITION) && (txsize == 3)) {
+    info->cmd = ICS_CMD_POSITION;
+    info->id = id;
+    info->value = (txbuf[1] << 7) + txbuf[2];
+  } else if ((head == ICS_CMD_HEAD_READ) && (txsize == 2)) {
+    info->id = id;
+    info->sc = txbuf[1];
+    if (txbuf[1] == ICS_SC_EEPROM) {
+      info->cmd = ICS_CMD_READEEPROM;
+    } else if (txbuf[1] == ICS_SC_POSITION) {
+      info->cmd = ICS_CMD_READPOSITION;
+    } else {
+      info->cmd = ICS_CMD_READPARAM;
+    }
+  } else if ((head == ICS_CMD_HEAD_WRITE) && (txsize == ICS_EEPROM_SIZE)) {
+    info->cmd = ICS_CMD_WRITEEEPROM;
+    info->id = id;
+    info->sc = txbuf[1];
+  } else if ((head == ICS_CMD_HEAD_WRITE) && (txsize == 3)) {
+    info->cmd = ICS_CMD_WRITEPARAM;
+    info->id = id;
+    info->sc = txbuf[1];
+    info->value = txbuf[2];
+  } else if ((head == ICS_CMD_HEAD_ID) && (txsize == 4)) {
+    info->cmd = ICS_CMD_ID;
+    // ID読み込み(0xFF)は全体宛て、ID書き込みは指定ID
+    if (txbuf[1] == 0x01) {
+      info->id = id;
+    }
+  } else {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  return RETCODE_OK;
+}
@@ -0,0 +1,82 @@
+#ifndef _ICS_CODEC_HPP_
+#define _ICS_CODEC_HPP_
+
+#include "IcsDefine.hpp"
+#include "stdint.h"
+
+// ICSコマンドの送信データ作成・受信データ解釈
+// IcsCommunication の各関数と、ホスト側のツール（トレース解析等）で共通に使う。
+// mbedに依存しない。送受信そのものは行わない。
+
+// コマンド上位3bit
+static const uint8_t ICS_CMD_HEAD_POSITION = 0x80;
+static const uint8_t ICS_CMD_HEAD_READ = 0xA0;
+static const uint8_t ICS_CMD_HEAD_WRITE = 0xC0;
+static const uint8_t ICS_CMD_HEAD_ID = 0xE0;
+
+// サブコマンド
+static const uint8_t ICS_SC_EEPROM = 0x00;
+static const uint8_t ICS_SC_STRETCH = 0x01;
+static const uint8_t ICS_SC_SPEED = 0x02;
+static const uint8_t ICS_SC_CURRENT = 0x03;
+static const uint8_t ICS_SC_TEMPERATURE = 0x04;
+static const uint8_t ICS_SC_POSITION = 0x05; // ICS3.6のみ
+
+static const int ICS_EEPROM_SIZE = 66;
+
+// コマンド種別
+enum IcsCommandType
+{
+  ICS_CMD_POSITION = 0,     // ポジション設定、脱力 3/3
+  ICS_CMD_READPARAM,        // パラメータ読み取り 2/3
+  ICS_CMD_WRITEPARAM,       // パラメータ書き込み 3/3
+  ICS_CMD_READEEPROM,       // EEPROM読み取り 2/66
+  ICS_CMD_WRITEEEPROM,      // EEPROM書き込み 66/2
+  ICS_CMD_READPOSITION,     // ICS3.6 現在位置取得 2/4
+  ICS_CMD_ID,               // ID読み書き 4/1
+  ICS_CMD_NUM
+};
+
+// コマンド種別ごとの送受信バイト数
+static const uint8_t ICS_CMD_TXSIZE[ICS_CMD_NUM] = {3, 2, 3, 2, 66, 2, 4};
+static const uint8_t ICS_CMD_RXSIZE[ICS_CMD_NUM] = {3, 3, 3, 66, 2, 4, 1};
+
+// 送信フレームの解釈結果（トレース解析用）
+struct IcsFrameInfo
+{
+  int cmd = ICS_CMD_NUM; // IcsCommandType、不明なら ICS_CMD_NUM
+  int id = -1;           // サーボID、ID読み込み（全体宛て）なら -1
+  int sc = -1;           // サブコマンド、無ければ -1
+  int value = -1;        // ポジション値、パラメータ値（無ければ -1）
+};
+
+// 上位下位4bitずつに分かれた2byteを、1byteにして取得する関数
+uint8_t ics_combine_2byte(uint8_t a, uint8_t b);
+
+// ポジション（移動・脱力）3/3
+int ics_encode_position(uint8_t *txbuf, uint8_t servolocalID, int val);
+int ics_decode_position(const uint8_t *rxbuf, uint8_t servolocalID);
+
+// パラメータ読み書き 2/3, 3/3
+int ics_encode_read_param(uint8_t *txbuf, uint8_t servolocalID,
+                          uint8_t sccode);
+int ics_decode_read_param(const uint8_t *rxbuf, uint8_t servolocalID,
+                          uint8_t sccode);
+int ics_encode_write_param(uint8_t *txbuf, uint8_t servolocalID,
+                           uint8_t sccode, int val);
+int ics_decode_write_param(const uint8_t *rxbuf, uint8_t servolocalID,
+                           uint8_t sccode);
+
+// ICS3.6 現在位置取得 2/4
+int ics_decode_read_position(const uint8_t *rxbuf, uint8_t servolocalID);
+
+// EEPROM 2/66, 66/2
+int ics_check_EEPROM_header(const uint8_t *rxbuf, uint8_t servolocalID);
+void ics_decode_EEPROM(const uint8_t *rxbuf, EEPROMdata *r_edata);
+void ics_encode_EEPROM(uint8_t *txbuf, EEPROMdata *w_edata);
+int ics_check_EEPROMdata(EEPROMdata *edata);
+
+// 送信フレームの種別判定（送信バイト数とコマンドから）
+int ics_decode_frame(const uint8_t *txbuf, int txsize, IcsFrameInfo *info);
+
+#endif
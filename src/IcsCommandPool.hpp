@@ -0,0 +1,165 @@
+#ifndef _ICS_COMMAND_POOL_HPP_
+#define _ICS_COMMAND_POOL_HPP_
+
+#include "IcsCodec.hpp"
+#include "stddef.h"
+#include "stdint.h"
+#include <atomic>
+
+// コマンド（送信フレーム・受信フレーム）の固定長プール
+// コマンドをキューに積んで後から送る場合などに、フレームの置き場所を
+// ヒープを使わずに確保する。スロット数はテンプレート引数でコンパイル時に決まり、
+// 使用RAMは ram_bytes() で分かる。
+// 大きさは2種類。
+//  small: 4byte（位置指令、パラメータ読み書き、ICS3.6の位置読み取り（返信4byte）、
+//         ID読み書き（送信4byte））
+//  large: 66byte（EEPROM読み書き）
+// 空きはスロットごとのビット（32スロットまで）で管理し、確保・解放はロックを
+// 取らずに O(1)（空きビットの検索はビット演算1回）。割り込みから呼んでもよい。
+// （Cortex-M0 等 LDREX/STREX の無いコアでは std::atomic が割り込み禁止で実装される）
+// 最大同時使用数（ハイウォーターマーク）を記録するので、実機で動かしてから
+// スロット数を必要な分だけに詰められる。mbedに依存しない。
+
+static const int ICS_FRAME_SMALL = 4;
+static const int ICS_FRAME_LARGE = ICS_EEPROM_SIZE;
+
+// コマンドスロット
+template <int FRAME_SIZE> struct IcsCommandSlot
+{
+  uint8_t servolocalID;
+  uint8_t txsize;
+  uint8_t rxsize;
+  int retcode;
+  uint8_t txbuf[FRAME_SIZE];
+  uint8_t rxbuf[FRAME_SIZE];
+};
+
+typedef IcsCommandSlot<ICS_FRAME_SMALL> IcsCommandSmall;
+typedef IcsCommandSlot<ICS_FRAME_LARGE> IcsCommandLarge;
+
+// 使用状況
+struct IcsPoolStats
+{
+  int inUse = 0;       // 使用中のスロット数
+  int highWater = 0;   // 最大同時使用数
+  uint32_t failed = 0; // 空きが無く確保できなかった回数
+};
+
+// 1種類の大きさのスロットの集まり
+template <typename SLOT, int NUM> class IcsSlotArray
+{
+  static_assert((NUM > 0) && (NUM <= 32), "slot count must be 1-32");
+
+  // プライベート変数
+private:
+  static const uint32_t ALL_MASK =
+      (NUM == 32) ? 0xFFFFFFFFUL : ((1UL << (NUM & 31)) - 1);
+
+  SLOT slot[NUM];
+  std::atomic<uint32_t> used; // 使用中のスロット（1 << 番号）
+  std::atomic<uint32_t> highWater;
+  std::atomic<uint32_t> failed;
+
+  // パブリック関数
+public:
+  IcsSlotArray() : used(0), highWater(0), failed(0) {}
+
+  // 確保　空きが無ければ nullptr
+  SLOT *alloc() {
+    uint32_t cur = used.load(std::memory_order_relaxed);
+    uint32_t bit;
+    do {
+      uint32_t freemask = ~cur & ALL_MASK;
+      if (freemask == 0) {
+        failed.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+      bit = freemask & (~freemask + 1); // 一番下の空き
+    } while (!used.compare_exchange_weak(cur, cur | bit,
+                                         std::memory_order_acquire,
+                                         std::memory_order_relaxed));
+
+    // ハイウォーターマークの更新
+    uint32_t num = __builtin_popcount(cur | bit);
+    uint32_t hw = highWater.load(std::memory_order_relaxed);
+    while ((num > hw) && !highWater.compare_exchange_weak(
+                             hw, num, std::memory_order_relaxed)) {
+    }
+
+    SLOT *s = &slot[__builtin_ctz(bit)];
+    s->txsize = 0;
+    s->rxsize = 0;
+    s->retcode = 0;
+    return s;
+  }
+
+  // 解放　このプールのスロットでなければ false
+  bool release(SLOT *s) {
+    if ((s < &slot[0]) || (s >= &slot[NUM])) {
+      return false;
+    }
+    uint32_t bit = 1UL << (s - &slot[0]);
+    uint32_t prev = used.fetch_and(~bit, std::memory_order_release);
+    return (prev & bit) != 0;
+  }
+
+  void get_stats(IcsPoolStats *stats) {
+    stats->inUse = __builtin_popcount(used.load(std::memory_order_relaxed));
+    stats->highWater = highWater.load(std::memory_order_relaxed);
+    stats->failed = failed.load(std::memory_order_relaxed);
+  }
+
+  // ハイウォーターマークを今の使用数に戻す
+  void reset_stats() {
+    highWater.store(__builtin_popcount(used.load(std::memory_order_relaxed)),
+                    std::memory_order_relaxed);
+    failed.store(0, std::memory_order_relaxed);
+  }
+};
+
+// small を SMALL_NUM 個、large を LARGE_NUM 個持つプール
+// 例）32サーボに位置指令を1周期分積み、EEPROMは1個ずつ扱う場合
+//   static IcsCommandPool<32, 1> pool;
+template <int SMALL_NUM, int LARGE_NUM> class IcsCommandPool
+{
+  // プライベート変数
+private:
+  IcsSlotArray<IcsCommandSmall, SMALL_NUM> small;
+  IcsSlotArray<IcsCommandLarge, LARGE_NUM> large;
+
+  // パブリック関数
+public:
+  // 確保　空きが無ければ nullptr
+  IcsCommandSmall *alloc_small() { return small.alloc(); }
+  IcsCommandLarge *alloc_large() { return large.alloc(); }
+
+  // 解放　このプールのスロットでない、または解放済みなら false
+  bool release(IcsCommandSmall *s) { return small.release(s); }
+  bool release(IcsCommandLarge *s) { return large.release(s); }
+
+  // フレームの大きさが small に入るか
+  static bool fits_small(int txsize, int rxsize) {
+    return (txsize <= ICS_FRAME_SMALL) && (rxsize <= ICS_FRAME_SMALL);
+  }
+
+  // 使用状況
+  void get_small_stats(IcsPoolStats *stats) { small.get_stats(stats); }
+  void get_large_stats(IcsPoolStats *stats) { large.get_stats(stats); }
+  void reset_stats() {
+    small.reset_stats();
+    large.reset_stats();
+  }
+
+  // プール全体のRAM（byte）　管理用の変数を含む
+  static size_t ram_bytes() { return sizeof(IcsCommandPool); }
+  // ハイウォーターマーク分のスロットだけにした場合のRAM（byte）
+  size_t needed_bytes() {
+    IcsPoolStats s, l;
+    small.get_stats(&s);
+    large.get_stats(&l);
+    return s.highWater * sizeof(IcsCommandSmall) +
+           l.highWater * sizeof(IcsCommandLarge);
+  }
+};
+
+#endif
@@ -31,27 +31,162 @@ bool IcsCommunication::begin(uint32_t brate, bool initFlag) {
   return true;
 }
 
+// 複数バス（UARTごとのIcsCommunication）の初期化関数
+// 引数：　IcsCommunicationの配列、個数、ボーレート、500msecウェイト有無
+//  begin をバスごとに呼ぶとウェイトがバス数分かかるので、
+//  全バスの信号線を同時にHighにして、ウェイトを1回で済ませる。
+bool IcsCommunication::begin_parallel(IcsCommunication *const *icslist, int num,
+                                      uint32_t brate, bool initFlag) {
+  if (initFlag) {
+    for (int a = 0; a < num; a++) {
+      icslist[a]->icsPin = 1;
+    }
+    wait_us(550 * 1000);
+    for (int a = 0; a < num; a++) {
+      icslist[a]->icsPin = 0;
+    }
+  }
+
+  for (int a = 0; a < num; a++) {
+    icslist[a]->begin(brate, false);
+    icslist[a]->initHigh = initFlag;
+  }
+  return true;
+}
+
 // ボーレート変更関数　いつでも変更可能
 //  ICSでは115200, 625000, 1250000 のみ対応
 void IcsCommunication::change_baudrate(uint32_t brate) {
   //  serial baud関数を使う
-  refSer->baud(brate);
+  baudrate = brate;
+  refSer->baud(baudrate);
+}
+
+// 通信記録（トレース）の設定　nullptr で記録しない
+void IcsCommunication::set_trace(IcsTrace *tr) { trace = tr; }
+
+// 現在のボーレート取得（IcsBusPlanner等の時間計算用）
+uint32_t IcsCommunication::get_baudrate() { return baudrate; }
+
+// 返信待ちタイムアウト設定（usec）
+//  最後にバイトを受信してからこの時間返信が無ければ、読み取りエラーとする。
+void IcsCommunication::set_timeout(uint32_t us) { timeoutUs = us; }
+
+uint32_t IcsCommunication::get_timeout() { return timeoutUs; }
+
+// 送信完了ビットの設定（STM32等、UARTレジスタを直接見られる場合）
+//  nullptr を渡すと、文字時間から計算して待つ方式に戻る。
+void IcsCommunication::set_tx_complete_flag(volatile uint32_t *status_reg,
+                                            uint32_t tc_mask) {
+  txStatusReg = status_reg;
+  txCompleteMask = tc_mask;
+}
+
+// write() 後に待つ文字数（レジスタ指定の無い場合）
+//  0 で待たない（従来の動作）。通常は送信データレジスタとシフトレジスタの 2。
+void IcsCommunication::set_tx_tail(int tail_chars) {
+  if (tail_chars < 0) {
+    tail_chars = 0;
+  }
+  txTailChars = tail_chars;
+}
+
+const IcsTurnaroundStats *IcsCommunication::get_turnaround_stats() {
+  return &turnaround;
+}
+
+void IcsCommunication::reset_turnaround_stats() {
+  turnaround = IcsTurnaroundStats();
+}
+
+// 低消費電力待ちの設定
+//  有効にすると、返信待ちの間は受信割り込みか期限タイマまでスリープする。
+//  sleep_min_us より残り時間が短い場合は、従来通りスリープせずに待つ。
+void IcsCommunication::set_low_power(bool en, uint32_t sleep_min_us) {
+  lowPower = en;
+  sleepMinUs = sleep_min_us;
+}
+
+// フレーム間の空き時間に、deadline_us までスリープする
+//  （制御周期の残り時間など。受信は待たない）
+void IcsCommunication::idle_until(uint32_t deadline_us) {
+  while ((int32_t)(deadline_us - us_ticker_read()) > 0) {
+    sleep_until(deadline_us, false);
+  }
+}
+
+const IcsSleepStats *IcsCommunication::get_sleep_stats() { return &sleepStats; }
+
+void IcsCommunication::reset_sleep_stats() {
+  sleepStats = IcsSleepStats();
+  cycleSleepMark = 0;
+}
+
+// 前回呼んでからのスリープ時間（制御周期ごとに呼んで、周期あたりの値を見る）
+uint32_t IcsCommunication::take_cycle_sleep_us() {
+  uint32_t us = sleepStats.sleepUs - cycleSleepMark;
+  cycleSleepMark = sleepStats.sleepUs;
+  return us;
 }
 
 // 基本的なサーボとのデータ送受信関数　すべてのベース
-// 引数：　送信バッファ、受信バッファ、送信サイズ、受信サイズ
+// 引数：　送信バッファ、受信バッファ、送信サイズ、受信サイズ、タイムアウト(usec)
+//  timeout が 0 の場合は set_timeout で設定した値を使う。
+//  トレースが設定されていれば、1往復分を記録する。
 int IcsCommunication::transceive(uint8_t *txbuf, uint8_t *rxbuf, uint8_t txsize,
-                                 uint8_t rxsize) {
+                                 uint8_t rxsize, uint32_t timeout) {
+  if (timeout == 0) {
+    timeout = timeoutUs;
+  }
+
+  // バスを確保してから非常脱力を確認する（emergency_free_all と逆順）
+  if (busy.exchange(true)) {
+    return RETCODE_ERROR_BUSBUSY;
+  }
+  // 非常脱力中は通常の通信をしない
+  if (emergency.load()) {
+    busy.store(false);
+    busFree.release();
+    return RETCODE_ERROR_ABORTED;
+  }
+
+  int tmpretcode;
+  if (trace == nullptr) {
+    tmpretcode = transceive_bus(txbuf, rxbuf, txsize, rxsize, timeout);
+  } else {
+    trace->begin(us_ticker_read(), baudrate, txbuf, txsize);
+    tmpretcode = transceive_bus(txbuf, rxbuf, txsize, rxsize, timeout);
+    trace->end(txDoneTime, us_ticker_read(), rxbuf, rxsize, rxCount,
+               tmpretcode);
+  }
+
+  busy.store(false);
+  if (emergency.load()) {
+    // 非常脱力のスレッドがバスの空きを待っている
+    busFree.release();
+  }
+  return tmpretcode;
+}
+
+// 送受信の実処理
+// 送信完了時刻を txDoneTime に、受信できたバイト数を rxCount に残す。
+int IcsCommunication::transceive_bus(uint8_t *txbuf, uint8_t *rxbuf,
+                                     uint8_t txsize, uint8_t rxsize,
+                                     uint32_t timeout) {
 
   int retLen;
   uint8_t tmpbyte = txbuf[0]; // デバッグ用
 
+  rxCount = 0;
+
   // 送信前にICS信号線をHighにする
   icsPin = 1;
   // 送信
   retLen = refSer->write(txbuf, txsize);
-  // 送信後にICS信号線をLowにする
+  // 最後のストップビットが出終わるのを待ってから、すぐにICS信号線をLowにする
+  uint32_t txend = wait_tx_complete(txsize);
   icsPin = 0;
+  txDoneTime = us_ticker_read();
 
   // 送信終わったのでtxbuf をゼロに（安全のため）
   for (int a = 0; a < txsize; a++) {
@@ -85,7 +220,36 @@ int IcsCommunication::transceive(uint8_t *txbuf, uint8_t *rxbuf, uint8_t txsize,
     refSer->read(&tmp, 1);
   }
 
-  retLen = refSer->read(rxbuf, rxsize);
+  // 受信　返信の無いサーボ（未接続ID、非対応コマンド）で止まらないよう、
+  // 1バイトずつ読んでタイムアウトを判定する
+  retLen = 0;
+  uint32_t lasttime = us_ticker_read();
+  uint32_t rxready = lasttime;
+  uint32_t firstbyte = 0;
+  while (retLen < rxsize) {
+    if (emergency.load()) {
+      // 非常脱力の要求　返信を待たずに抜ける
+      rxCount = retLen;
+      return RETCODE_ERROR_ABORTED;
+    }
+    if (refSer->readable()) {
+      refSer->read(&rxbuf[retLen], 1);
+      lasttime = us_ticker_read();
+      if (retLen == 0) {
+        firstbyte = lasttime;
+      }
+      retLen++;
+    } else if ((uint32_t)(us_ticker_read() - lasttime) > timeout) {
+      break;
+    } else if (lowPower && (retLen == 0)) {
+      // 返信の1バイト目かタイムアウトまでスリープ
+      // 2バイト目以降は文字間隔（1.25Mbpsで 8.8usec）が起床時間より短く、
+      // 受信レジスタ1byteのUARTでは取りこぼすので、フレームの終わりまでポーリング
+      sleep_until(lasttime + timeout + 1, true);
+    }
+  }
+  rxCount = retLen;
+  add_turnaround(txend, rxready, firstbyte, retLen > 0);
 
   if (retLen != rxsize) {
     return RETCODE_ERROR_ICSWRITE;
@@ -94,6 +258,260 @@ int IcsCommunication::transceive(uint8_t *txbuf, uint8_t *rxbuf, uint8_t txsize,
   return RETCODE_OK;
 }
 
+// 1文字の時間（usec、切り上げ）
+uint32_t IcsCommunication::char_us() {
+  return (BITS_PER_CHAR * 1000000 + baudrate - 1) / baudrate;
+}
+
+// 送信完了待ち
+// 戻り値に送信完了（最後のストップビット送出）の時刻が入ります。
+//  状態レジスタが設定されていれば送信完了ビットを待つ（1文字分の時間 ×
+//  送信サイズ + 余裕 で打ち切り）。無ければ、write() から戻った時点で
+//  まだ送信中の文字数（最大 txTailChars）分の時間を待つ。
+uint32_t IcsCommunication::wait_tx_complete(uint8_t txsize) {
+  uint32_t start = us_ticker_read();
+  uint32_t charus = char_us();
+
+  if (txStatusReg != nullptr) {
+    uint32_t limit = charus * (txsize + 2);
+    while ((*txStatusReg & txCompleteMask) == 0) {
+      if ((uint32_t)(us_ticker_read() - start) > limit) {
+        break;
+      }
+    }
+    return us_ticker_read();
+  }
+
+  int tail = (txsize < txTailChars) ? txsize : txTailChars;
+  uint32_t waitus = charus * tail;
+  while ((uint32_t)(us_ticker_read() - start) < waitus) {
+  }
+  return start + waitus;
+}
+
+// ターンアラウンド計測結果の追加
+void IcsCommunication::add_turnaround(uint32_t txend, uint32_t rxready,
+                                      uint32_t firstbyte, bool replied) {
+  IcsTurnaroundStats *ts = &turnaround;
+  uint32_t ta = rxready - txend;
+
+  if ((ts->count == 0) || (ta < ts->turnaroundMin)) {
+    ts->turnaroundMin = ta;
+  }
+  if (ta > ts->turnaroundMax) {
+    ts->turnaroundMax = ta;
+  }
+  ts->turnaroundSum += ta;
+  ts->count++;
+
+  if (replied) {
+    uint32_t rep = firstbyte - txend;
+    if ((ts->replyCount == 0) || (rep < ts->replyMin)) {
+      ts->replyMin = rep;
+    }
+    if (rep > ts->replyMax) {
+      ts->replyMax = rep;
+    }
+    ts->replySum += rep;
+    ts->replyCount++;
+  }
+}
+
+// 受信割り込み　1回起こしたら割り込みを外す（データは読まずに本体側で読む）
+void IcsCommunication::on_rx_irq() {
+  rxWake = true;
+  refSer->attach(nullptr, SerialBase::RxIrq);
+}
+
+void IcsCommunication::on_wake_timer() { timerWake = true; }
+
+// deadline_us までスリープ　wake_on_rx なら受信でも起きる
+// 割り込み禁止中に起床条件を確認してからスリープするので、確認直後に来た
+// 割り込みでも起きる（Cortex-M の WFI は割り込み禁止中でも保留割り込みで復帰する）。
+void IcsCommunication::sleep_until(uint32_t deadline_us, bool wake_on_rx) {
+  int32_t remain = deadline_us - us_ticker_read();
+  if ((remain <= 0) || ((uint32_t)remain < sleepMinUs)) {
+    return;
+  }
+
+  rxWake = false;
+  timerWake = false;
+  if (wake_on_rx) {
+    refSer->attach(callback(this, &IcsCommunication::on_rx_irq),
+                   SerialBase::RxIrq);
+  }
+  wakeTimer.attach(callback(this, &IcsCommunication::on_wake_timer),
+                   std::chrono::microseconds(remain));
+
+  uint32_t t0 = us_ticker_read();
+  core_util_critical_section_enter();
+  if (!rxWake && !timerWake && !(wake_on_rx && refSer->readable()) &&
+      !emergency.load()) {
+    sleep();
+  }
+  core_util_critical_section_exit();
+  uint32_t t1 = us_ticker_read();
+
+  wakeTimer.detach();
+  if (wake_on_rx) {
+    refSer->attach(nullptr, SerialBase::RxIrq);
+  }
+
+  // 統計　割り込み処理後の値で判定する
+  sleepStats.sleeps++;
+  sleepStats.sleepUs += t1 - t0;
+  if (timerWake) {
+    sleepStats.timerWakes++;
+    int32_t late = t1 - deadline_us;
+    if (late > 0) {
+      sleepStats.wakeLatencySum += late;
+      if ((uint32_t)late > sleepStats.wakeLatencyMax) {
+        sleepStats.wakeLatencyMax = late;
+      }
+    }
+  } else if (rxWake) {
+    sleepStats.rxWakes++;
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// 非常脱力
+
+// 通信の中断要求（割り込みから呼べる）
+// 受信待ちでスリープ中の往復は、この割り込み自体で起きて中断する
+void IcsCommunication::request_abort() { emergency.store(true); }
+
+void IcsCommunication::set_emergency_window(uint32_t window_us) {
+  emergencyWindowUs = window_us;
+}
+
+// 非常脱力の解除　通常の通信に戻す
+void IcsCommunication::clear_emergency() { emergency.store(false); }
+
+bool IcsCommunication::is_emergency() { return emergency.load(); }
+
+// 非常脱力の最悪時間（usec）
+//  バスの空き待ち + 1フレームの最悪時間 × ID数 × (1 + retries)
+uint32_t IcsCommunication::emergency_bound_us(uint32_t idmask, int retries) {
+  uint32_t charus = char_us();
+  int idnum = 0;
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if ((idmask >> id) & 1) {
+      idnum++;
+    }
+  }
+
+  // 送信完了待ちの最大文字数（wait_tx_complete 参照）
+  uint32_t tail = (txStatusReg != nullptr) ? (3 + 2) : txTailChars;
+
+  // 送信3byte + 送信完了待ち + 返信待ち + 返信3byte、処理時間の余裕 1文字
+  uint32_t frame = charus * (3 + tail + 3 + 1) + emergencyWindowUs;
+  return emergency_wait_us() + frame * idnum * (1 + retries);
+}
+
+// 通信中だった往復の送信が終わるまでの最悪時間（EEPROM書き込み 66byte）
+uint32_t IcsCommunication::emergency_inflight_us() {
+  uint32_t tail = (txStatusReg != nullptr) ? (ICS_EEPROM_SIZE + 2) : txTailChars;
+  return char_us() * (ICS_EEPROM_SIZE + tail);
+}
+
+// バスの空き待ちの上限
+// 通信中だった往復の送信が終わるまで + 相手スレッドが動いて抜けるまでの余裕
+// （受信待ちの往復は emergency を見てすぐに抜ける）
+uint32_t IcsCommunication::emergency_wait_us() {
+  return emergency_inflight_us() + EMERGENCY_SCHED_US;
+}
+
+// 脱力フレーム1つの送信　返信の1バイト目が本人のIDなら受理とみなす
+// 戻り値に返信があれば true
+bool IcsCommunication::emergency_free(uint8_t servolocalID) {
+  uint8_t txbuf[3];
+  uint8_t rxbuf[3];
+
+  ics_encode_position(txbuf, servolocalID, 0);
+
+  icsPin = 1;
+  refSer->write(txbuf, sizeof(txbuf));
+  uint32_t txend = wait_tx_complete(sizeof(txbuf));
+  icsPin = 0;
+
+  while (refSer->readable() > 0) { // 折り返しの空読み
+    uint8_t tmp = 0;
+    refSer->read(&tmp, 1);
+  }
+
+  // 返信待ちは期限を固定する（バイト間タイムアウトにしない）
+  uint32_t deadline = txend + emergencyWindowUs + char_us() * 3;
+  int len = 0;
+  while ((len < (int)sizeof(rxbuf)) &&
+         ((int32_t)(deadline - us_ticker_read()) > 0)) {
+    if (refSer->readable()) {
+      refSer->read(&rxbuf[len], 1);
+      len++;
+    }
+  }
+
+  return (len > 0) && ((rxbuf[0] & 0b01111111) == servolocalID);
+}
+
+// 非常脱力
+// 戻り値にRETCODE_OK（1の値、全IDから返信あり）、またはエラーコード（負の値）が入ります。
+// 返信の無いIDがあっても、脱力フレーム自体は全IDに送っている。
+int IcsCommunication::emergency_free_all(uint32_t idmask, int retries,
+                                         IcsEmergencyResult *result) {
+  IcsEmergencyResult res;
+  uint32_t start = us_ticker_read();
+
+  if (retries < 0) {
+    retries = 0;
+  }
+  res.boundUs = emergency_bound_us(idmask, retries);
+
+  // 他スレッドの往復を中断させ、バスが空くのを待って確保する
+  // 待つ間は回り続けずにスリープし、相手スレッド（優先度が低くても）を動かす。
+  // 相手は抜けるときに busFree で知らせる。通知を取り逃しても 1msec ごとに見直す。
+  emergency.store(true);
+  uint32_t limit = emergency_wait_us();
+  bool expected = false;
+  while (!busy.compare_exchange_strong(expected, true)) {
+    expected = false;
+    if ((uint32_t)(us_ticker_read() - start) >= limit) {
+      // 時間内に放されなかった　二重送信になるので、ここでは何も送らない
+      res.failMask = idmask;
+      res.elapsedUs = us_ticker_read() - start;
+      if (result != nullptr) {
+        *result = res;
+      }
+      return RETCODE_ERROR_BUSBUSY;
+    }
+    busFree.try_acquire_for(std::chrono::milliseconds(1));
+  }
+
+  // 1周目は全ID、2周目以降は返信の無かったIDのみ
+  uint32_t pending = idmask;
+  for (int round = 0; (round <= retries) && (pending != 0); round++) {
+    for (int id = ID_MIN; id <= ID_MAX; id++) {
+      if (((pending >> id) & 1) == 0) {
+        continue;
+      }
+      res.attempts++;
+      if (emergency_free(id)) {
+        res.ackMask |= 1UL << id;
+        pending &= ~(1UL << id);
+      }
+    }
+  }
+  busy.store(false);
+  res.failMask = pending;
+  res.elapsedUs = us_ticker_read() - start;
+
+  if (result != nullptr) {
+    *result = res;
+  }
+  return (pending == 0) ? RETCODE_OK : RETCODE_ERROR_ICSWRITE;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////
 // サーボ制御系
@@ -126,21 +544,14 @@ int IcsCommunication::set_position(uint8_t servolocalID, int val) {
   }
 
   // 送信データ作成
-  txbuf[0] = 0x80 | servolocalID;
-  txbuf[1] = val >> 7;
-  txbuf[2] = val & 0b0000000001111111;
+  ics_encode_position(txbuf, servolocalID, val);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
   // 受信データ確認
   if (retcode == RETCODE_OK) {
-    if ((rxbuf[0] & 0b01111111) == servolocalID) {
-      retval = (rxbuf[1] << 7) + (rxbuf[2]);
-      return retval;
-    } else {
-      return RETCODE_ERROR_IDWRONG;
-    }
+    return ics_decode_position(rxbuf, servolocalID);
   } else {
     // error
     return retcode;
@@ -168,21 +579,14 @@ int IcsCommunication::set_position_weak(uint8_t servolocalID) {
   }
 
   // 送信データ作成
-  txbuf[0] = 0x80 | servolocalID;
-  txbuf[1] = 0;
-  txbuf[2] = 0;
+  ics_encode_position(txbuf, servolocalID, 0);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
   // 受信データ確認
   if (retcode == RETCODE_OK) {
-    if ((rxbuf[0] & 0b01111111) == servolocalID) {
-      retval = (rxbuf[1] << 7) + (rxbuf[2]);
-      return retval;
-    } else {
-      return RETCODE_ERROR_IDWRONG;
-    }
+    return ics_decode_position(rxbuf, servolocalID);
   } else {
     // error
     return retcode;
@@ -210,34 +614,24 @@ int IcsCommunication::set_position_weakandkeep(uint8_t servolocalID) {
   }
 
   // １回目の送信データ作成
-  txbuf[0] = 0x80 | servolocalID;
-  txbuf[1] = 0;
-  txbuf[2] = 0;
+  ics_encode_position(txbuf, servolocalID, 0);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
   // 受信データ確認
   if (retcode == RETCODE_OK) {
-    if ((rxbuf[0] & 0b01111111) == servolocalID) {
-      retval = (rxbuf[1] << 7) + (rxbuf[2]);
-
+    retval = ics_decode_position(rxbuf, servolocalID);
+    if (retval >= 0) {
       // ２回目の送信データ作成
-      txbuf[0] = 0x80 | servolocalID;
-      txbuf[1] = retval >> 7;
-      txbuf[2] = retval & 0b0000000001111111;
+      ics_encode_position(txbuf, servolocalID, retval);
 
       // ２回目のICS送信
       retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
       // ２回目の受信データ確認
       if (retcode == RETCODE_OK) {
-        if ((rxbuf[0] & 0b01111111) == servolocalID) {
-          retval = (rxbuf[1] << 7) + (rxbuf[2]);
-          return retval;
-        } else {
-          return RETCODE_ERROR_IDWRONG;
-        }
+        return ics_decode_position(rxbuf, servolocalID);
       } else {
         // error
         return retcode;
@@ -251,6 +645,117 @@ int IcsCommunication::set_position_weakandkeep(uint8_t servolocalID) {
   }
 }
 
+// 現在位置取得
+// ICS3.6サーボでは位置取得コマンドで1往復のみ（脱力しない）、
+// ICS3.5サーボでは set_position_weakandkeep（脱力後即動作）で代用する。
+// どちらを使うかはIDごとに検出し（get_icsversion）、以降はキャッシュを使う。
+// 検出できなかった場合はエラーを返す（脱力はしない）。
+// 戻り値に現在位置が入ります。
+int IcsCommunication::get_position(uint8_t servolocalID) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  switch (get_icsversion(servolocalID)) {
+  case ICS_VERSION_36:
+    return read_position(servolocalID);
+  case ICS_VERSION_35:
+    return set_position_weakandkeep(servolocalID);
+  default:
+    // 未検出のまま脱力させないよう、ここでは何もしない
+    return RETCODE_ERROR_ICSREAD;
+  }
+}
+
+// ICS3.6 現在位置読み取りコマンド
+// 3.5サーボには存在しないサブコマンドなので、返信が来ずタイムアウトとなる。
+// 戻り値に現在位置、またはエラーコード（負の値）が入ります。
+int IcsCommunication::read_position(uint8_t servolocalID) {
+  int txsize = 2;
+  int rxsize = 4;
+  uint8_t txbuf[2];
+  uint8_t rxbuf[4];
+
+  for (int a = 0; a < sizeof(txbuf); a++) {
+    txbuf[a] = 0;
+  }
+  for (int a = 0; a < sizeof(rxbuf); a++) {
+    rxbuf[a] = 0;
+  }
+
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  // 送信データ作成
+  ics_encode_read_param(txbuf, servolocalID, SC_CODE_POSITION);
+
+  // ICS送信
+  retcode = transceive(txbuf, rxbuf, txsize, rxsize);
+
+  // 受信データ確認
+  if (retcode == RETCODE_OK) {
+    // バッファチェック　ID, SC
+    return ics_decode_read_position(rxbuf, servolocalID);
+  } else {
+    // error
+    return retcode;
+  }
+}
+
+// サーボのICSバージョン検出
+// まず3.6の位置取得コマンドを試し、返信が正しければ3.6とする。
+// 返信が1バイトも無く、ストレッチ読み取り（3.5共通）には応答する、という結果が
+// ICS_PROBE35_CONFIRM 回続いたときだけ3.5とする（3.6サーボの返信が1回欠けただけで
+// 3.5と決めつけると、以後の get_position が毎回脱力してしまうため）。
+// 返信が途中で切れた・化けた場合や、どちらにも応答しない場合はキャッシュせず、
+// 次回呼び出し時に再検出する。
+// 戻り値に ICS_VERSION_35, ICS_VERSION_36, ICS_VERSION_UNKNOWN のどれかが入ります。
+int IcsCommunication::get_icsversion(uint8_t servolocalID) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return ICS_VERSION_UNKNOWN;
+  }
+
+  if (icsVersion[servolocalID] != ICS_VERSION_UNKNOWN) {
+    return icsVersion[servolocalID];
+  }
+
+  for (int a = 0; a < ICS_PROBE35_CONFIRM; a++) {
+    if (read_position(servolocalID) >= 0) {
+      icsVersion[servolocalID] = ICS_VERSION_36;
+      return ICS_VERSION_36;
+    }
+    // 「コマンド非対応」とみなせるのは、返信が全く無かった場合のみ
+    if ((retcode != RETCODE_ERROR_ICSWRITE) || (rxCount != 0)) {
+      return ICS_VERSION_UNKNOWN;
+    }
+    if (read_Param(servolocalID, SC_CODE_STRETCH) < 0) {
+      return ICS_VERSION_UNKNOWN;
+    }
+  }
+
+  icsVersion[servolocalID] = ICS_VERSION_35;
+  return ICS_VERSION_35;
+}
+
+// キャッシュ済みのICSバージョン取得　未検出なら ICS_VERSION_UNKNOWN（通信しない）
+int IcsCommunication::get_icsversion_cached(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return ICS_VERSION_UNKNOWN;
+  }
+  return icsVersion[servolocalID];
+}
+
+// ICSバージョン検出結果のキャッシュを破棄する（サーボ交換、ID変更時など）
+void IcsCommunication::clear_icsversion() {
+  for (int a = 0; a < ID_NUM; a++) {
+    icsVersion[a] = ICS_VERSION_UNKNOWN;
+  }
+}
+
 // EEPROM以外のパラメータ読み取りコマンド
 // 引数：サーボＩＤ、ポジション値(3500-11500)
 // sccode は、SC_CODE_STRETCH, SC_CODE_SPEED, SC_CODE_CURRENT,
@@ -281,20 +786,22 @@ int IcsCommunication::read_Param(uint8_t servolocalID, uint8_t sccode) {
   }
 
   // 送信データ作成
-  txbuf[0] = 0xA0 | servolocalID;
-  txbuf[1] = sccode;
+  ics_encode_read_param(txbuf, servolocalID, sccode);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
   // 受信データ確認
   if (retcode == RETCODE_OK) {
-    if ((rxbuf[0] == (0x20 | servolocalID)) && (rxbuf[1] == sccode)) {
-      // バッファチェック　ID, SC
-      return rxbuf[2];
-    } else {
-      return RETCODE_ERROR_RETURNDATAWRONG;
+    // バッファチェック　ID, SC
+    retval = ics_decode_read_param(rxbuf, servolocalID, sccode);
+    // stretch/speed は設定値が返るので、書き込み済みの値として覚える
+    // （電流・温度は現在値なので覚えない）
+    if ((retval > 0) &&
+        ((sccode == SC_CODE_STRETCH) || (sccode == SC_CODE_SPEED))) {
+      paramWritten[servolocalID][sccode - 1] = retval;
     }
+    return retval;
   } else {
     // error
     return retcode;
@@ -332,24 +839,40 @@ int IcsCommunication::write_Param(uint8_t servolocalID, uint8_t sccode,
   }
 
   // 送信データ作成
-  txbuf[0] = 0xC0 | servolocalID;
-  txbuf[1] = sccode;
-  txbuf[2] = val;
+  ics_encode_write_param(txbuf, servolocalID, sccode, val);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
   // 受信データ確認
   if (retcode == RETCODE_OK) {
-    if ((rxbuf[0] == (0x40 | servolocalID)) && (rxbuf[1] == sccode)) {
-      // バッファチェック　ID, SC
-      return RETCODE_OK;
-    } else {
-      return RETCODE_ERROR_RETURNDATAWRONG;
+    // バッファチェック　ID, SC
+    retcode = ics_decode_write_param(rxbuf, servolocalID, sccode);
+  }
+  // 失敗した場合は書けたかどうか分からないので、不明にする
+  paramWritten[servolocalID][sccode - 1] =
+      ((retcode == RETCODE_OK) && (val > 0) && (val < 256)) ? val : 0;
+  return retcode;
+}
+
+// パラメータの書き込み済みの値
+// 戻り値に値、または不明なら 0 が入ります。
+int IcsCommunication::get_param_written(uint8_t servolocalID, uint8_t sccode) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX) ||
+      (sccode < SC_CODE_STRETCH) || (sccode > SC_CODE_TEMPERATURE)) {
+    return 0;
+  }
+  return paramWritten[servolocalID][sccode - 1];
+}
+
+// パラメータの書き込み済みの値を不明にする（サーボの電源を入れ直した場合など）
+void IcsCommunication::forget_param_written(uint32_t idmask) {
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if ((idmask >> id) & 1) {
+      for (int a = 0; a < 4; a++) {
+        paramWritten[id][a] = 0;
+      }
     }
-  } else {
-    // error
-    return retcode;
   }
 }
 
@@ -450,8 +973,7 @@ int IcsCommunication::read_EEPROMraw(uint8_t servolocalID, uint8_t *rxbuf) {
   }
 
   // 送信データ作成
-  txbuf[0] = 0xA0 | servolocalID;
-  txbuf[1] = sccode;
+  ics_encode_read_param(txbuf, servolocalID, sccode);
 
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
@@ -462,9 +984,50 @@ int IcsCommunication::read_EEPROMraw(uint8_t servolocalID, uint8_t *rxbuf) {
   }
 
   // バッファチェック　ID, SC, 0x5A
-  if ((rxbuf[0] != (0x20 | servolocalID)) || (rxbuf[1] != sccode) ||
-      (rxbuf[2] != 0x5) || (rxbuf[3] != 0xA)) {
-    // debugPrint("ID,SC,0x5A error.\r\n");
+  return ics_check_EEPROM_header(rxbuf, servolocalID);
+}
+
+// EEPROM書き込み（生バイト）
+// 引数：　サーボＩＤ、EEPROM生バイト（read_EEPROMraw で読んだものを変更した66byte）
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+// 書き込み前の読み取りをしないので、返信が不安定なサーボにも書き込める
+// （その場合、返信エラーでも書き込み自体はされていることがある）。
+int IcsCommunication::write_EEPROMraw(uint8_t servolocalID,
+                                      const uint8_t *image) {
+  uint8_t buf[ICS_EEPROM_SIZE];
+  uint8_t sccode = SC_CODE_EEPROM;
+
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  // EEPROMデータ先頭の0x5Aチェック
+  if (ics_combine_2byte(image[2], image[3]) != 0x5A) {
+    return RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  for (int a = 0; a < ICS_EEPROM_SIZE; a++) {
+    buf[a] = image[a];
+  }
+  buf[0] = ICS_CMD_HEAD_WRITE | servolocalID;
+  buf[1] = sccode;
+
+  // IDが書き換わる場合、ICSバージョンのキャッシュは当てにならない
+  if (ics_combine_2byte(buf[58], buf[59]) != servolocalID) {
+    clear_icsversion();
+    forget_param_written();
+  }
+
+  // EEPROMを書き換えると、パラメータの書き込み済みの値は当てにならない
+  forget_param_written(1UL << servolocalID);
+  // ICS送信　書き込み完了まで返信が来ないので、タイムアウトを長くとる
+  retcode = transceive(buf, buf, ICS_EEPROM_SIZE, 2, TIMEOUT_EEPROMWRITE_US);
+  if (retcode != RETCODE_OK) {
+    return retcode;
+  }
+
+  // バッファチェック　ID, SC
+  if ((buf[0] != (0x40 | servolocalID)) || (buf[1] != sccode)) {
     return RETCODE_ERROR_RETURNDATAWRONG;
   }
 
@@ -486,58 +1049,9 @@ int IcsCommunication::get_EEPROM(uint8_t servolocalID, EEPROMdata *r_edata) {
     return retcode;
   }
 
-  r_edata->stretch =
-      combine_2byte(rxbuf[4], rxbuf[5]) / 2; // 2倍値で収納されてる
-  r_edata->speed = combine_2byte(rxbuf[6], rxbuf[7]);
-  r_edata->punch = combine_2byte(rxbuf[8], rxbuf[9]);
-  r_edata->deadband = combine_2byte(rxbuf[10], rxbuf[11]);
-  r_edata->dumping = combine_2byte(rxbuf[12], rxbuf[13]);
-  r_edata->safetimer = combine_2byte(rxbuf[14], rxbuf[15]);
-
-  r_edata->flag_slave = (rxbuf[16] >> 3) & 0b00000001;
-  r_edata->flag_rotation = (rxbuf[16]) & 0b00000001;
-  r_edata->flag_pwminh = (rxbuf[17] >> 3) & 0b00000001;
-  r_edata->flag_free = (rxbuf[17] >> 1) & 0b00000001;
-  r_edata->flag_reverse = (rxbuf[17]) & 0b00000001;
-
-  r_edata->poslimithigh = (combine_2byte(rxbuf[18], rxbuf[19]) << 8) |
-                          combine_2byte(rxbuf[20], rxbuf[21]);
-  r_edata->poslimitlow = (combine_2byte(rxbuf[22], rxbuf[23]) << 8) |
-                         combine_2byte(rxbuf[24], rxbuf[25]);
-
-  int commflagval = combine_2byte(rxbuf[28], rxbuf[29]);
-  if (commflagval == 0x00) {
-    r_edata->commspeed = 1250000;
-  } else if (commflagval == 0x01) {
-    r_edata->commspeed = 625000;
-  } else if (commflagval == 0x0A) {
-    r_edata->commspeed = 115200;
-  } else {
-    r_edata->commspeed = EEPROM_NOTCHANGE;
-  }
-
-  r_edata->temperaturelimit = combine_2byte(rxbuf[30], rxbuf[31]);
-  r_edata->currentlimit = combine_2byte(rxbuf[32], rxbuf[33]);
-  r_edata->response = combine_2byte(rxbuf[52], rxbuf[53]);
-
-  uint8_t tmpoffset = combine_2byte(rxbuf[54], rxbuf[55]);
-  // ICSマネージャ挙動では、正負反対に収納されているのでそれに合わせる
-  if ((tmpoffset >> 7) == 0b00000001) { // 負ビット
-    r_edata->offset = ((~(tmpoffset)&0b01111111) + 1);
-  } else { // 正ビット
-    r_edata->offset = 0 - tmpoffset;
-  }
-
-  r_edata->ID = combine_2byte(rxbuf[58], rxbuf[59]);
-
-  r_edata->charstretch1 =
-      combine_2byte(rxbuf[60], rxbuf[61]) / 2; // 2倍値で収納されてる
-  r_edata->charstretch2 =
-      combine_2byte(rxbuf[62], rxbuf[63]) / 2; // 2倍値で収納されてる
-  r_edata->charstretch3 =
-      combine_2byte(rxbuf[64], rxbuf[65]) / 2; // 2倍値で収納されてる
+  ics_decode_EEPROM(rxbuf, r_edata);
 
-  retcode = check_EEPROMdata(r_edata);
+  retcode = ics_check_EEPROMdata(r_edata);
 
   if (retcode != RETCODE_OK) {
     // debugPrint("get_EEPROM inside check_EEPROMdata error. retcode: " +
@@ -576,7 +1090,7 @@ int IcsCommunication::set_EEPROM(uint8_t servolocalID, EEPROMdata *w_edata) {
     return RETCODE_ERROR_OPTIONWRONG;
   }
   // 変更禁止部分以外の、設定値の正当性チェック
-  retcode = check_EEPROMdata(w_edata);
+  retcode = ics_check_EEPROMdata(w_edata);
   if (retcode != RETCODE_OK) {
     return RETCODE_ERROR_EEPROMDATAWRONG;
   }
@@ -590,7 +1104,7 @@ int IcsCommunication::set_EEPROM(uint8_t servolocalID, EEPROMdata *w_edata) {
   }
 
   // EEPROMデータ先頭の0x5Aチェック
-  int checkdata = combine_2byte(rxbuf[2], rxbuf[3]);
+  int checkdata = ics_combine_2byte(rxbuf[2], rxbuf[3]);
   if (checkdata != 0x5A) {
     return RETCODE_ERROR_EEPROMDATAWRONG;
   }
@@ -608,303 +1122,94 @@ int IcsCommunication::set_EEPROM(uint8_t servolocalID, EEPROMdata *w_edata) {
   txbuf[1] = sccode;
 
   // 送信バッファtxbuf に、引数で受け取ったEEPROMデータの変更部分のみコピーする
-  if (w_edata->stretch != EEPROM_NOTCHANGE) {
-    txbuf[4] =
-        (uint8_t)(w_edata->stretch * 2) >> 4; // 2倍値で収納されてるので処理
-    txbuf[5] = (uint8_t)(w_edata->stretch * 2) & 0b0000000000001111;
-  }
+  ics_encode_EEPROM(txbuf, w_edata);
 
-  if (w_edata->speed != EEPROM_NOTCHANGE) {
-    txbuf[6] = (uint8_t)(w_edata->speed) >> 4;
-    txbuf[7] = (uint8_t)(w_edata->speed) & 0b0000000000001111;
-  }
-  if (w_edata->punch != EEPROM_NOTCHANGE) {
-    txbuf[8] = (uint8_t)(w_edata->punch) >> 4;
-    txbuf[9] = (uint8_t)(w_edata->punch) & 0b0000000000001111;
-  }
-  if (w_edata->deadband != EEPROM_NOTCHANGE) {
-    txbuf[10] = (uint8_t)(w_edata->deadband) >> 4;
-    txbuf[11] = (uint8_t)(w_edata->deadband) & 0b0000000000001111;
-  }
-  if (w_edata->dumping != EEPROM_NOTCHANGE) {
-    txbuf[12] = (uint8_t)(w_edata->dumping) >> 4;
-    txbuf[13] = (uint8_t)(w_edata->dumping) & 0b0000000000001111;
-  }
-  if (w_edata->safetimer != EEPROM_NOTCHANGE) {
-    txbuf[14] = (uint8_t)(w_edata->safetimer) >> 4;
-    txbuf[15] = (uint8_t)(w_edata->safetimer) & 0b0000000000001111;
-  }
+  // EEPROMを書き換えると、パラメータの書き込み済みの値は当てにならない
+  forget_param_written(1UL << servolocalID);
+  // ICS送信　書き込み完了まで返信が来ないので、タイムアウトを長くとる
+  retcode =
+      transceive(txbuf, rxbuf, txsize, rxsize, TIMEOUT_EEPROMWRITE_US);
 
-  if (w_edata->flag_slave != EEPROM_NOTCHANGE) {
-    if (w_edata->flag_slave == 1) {
-      txbuf[16] = txbuf[16] | 0b00001000;
-    }
-    if (w_edata->flag_slave == 0) {
-      txbuf[16] = txbuf[16] & 0b11110111;
-    }
-  }
-  if (w_edata->flag_rotation != EEPROM_NOTCHANGE) {
-    if (w_edata->flag_rotation == 1) {
-      txbuf[16] = txbuf[16] | 0b00000001;
-    }
-    if (w_edata->flag_rotation == 0) {
-      txbuf[16] = txbuf[16] & 0b11111110;
-    }
-  }
-  if (w_edata->flag_pwminh != EEPROM_NOTCHANGE) {
-    if (w_edata->flag_pwminh == 1) {
-      txbuf[17] = txbuf[17] | 0b00001000;
-    }
-    if (w_edata->flag_pwminh == 0) {
-      txbuf[17] = txbuf[17] & 0b11110111;
-    }
-  }
-  if (w_edata->flag_free != EEPROM_NOTCHANGE) {
-    // freeフラグは参照のみとのこと。ここを書き込む事は、マニュアル等に説明は無いので挙動不明
-    // if (w_edata->flag_free == 1) { txbuf[17] = txbuf[17] | 0b00000010 ; }
-    // if (w_edata->flag_free == 0) { txbuf[17] = txbuf[17] & 0b11111101 ; }
-  }
-  if (w_edata->flag_reverse != EEPROM_NOTCHANGE) {
-    if (w_edata->flag_reverse == 1) {
-      txbuf[17] = txbuf[17] | 0b00000001;
-    }
-    if (w_edata->flag_reverse == 0) {
-      txbuf[17] = txbuf[17] & 0b11111110;
-    }
+  if (retcode != RETCODE_OK) {
+    // debugPrint("error: " + String(retcode));
+    return retcode;
   }
 
-  if (w_edata->poslimithigh != EEPROM_NOTCHANGE) {
-    txbuf[18] =
-        (w_edata->poslimithigh >> 12) & 0b00000000000000000000000000001111;
-    txbuf[19] =
-        (w_edata->poslimithigh >> 8) & 0b00000000000000000000000000001111;
-    txbuf[20] =
-        (w_edata->poslimithigh >> 4) & 0b00000000000000000000000000001111;
-    txbuf[21] = (w_edata->poslimithigh) & 0b00000000000000000000000000001111;
-  }
-
-  if (w_edata->poslimitlow != EEPROM_NOTCHANGE) {
-    txbuf[22] =
-        (w_edata->poslimitlow >> 12) & 0b00000000000000000000000000001111;
-    txbuf[23] =
-        (w_edata->poslimitlow >> 8) & 0b00000000000000000000000000001111;
-    txbuf[24] =
-        (w_edata->poslimitlow >> 4) & 0b00000000000000000000000000001111;
-    txbuf[25] = (w_edata->poslimitlow) & 0b00000000000000000000000000001111;
-  }
-
-  if (w_edata->commspeed != EEPROM_NOTCHANGE) {
-    if (w_edata->commspeed == 115200) {
-      txbuf[28] = 0x0;
-      txbuf[29] = 0xA;
-    } else if (w_edata->commspeed == 625000) {
-      txbuf[28] = 0x0;
-      txbuf[29] = 0x1;
-    } else if (w_edata->commspeed == 1250000) {
-      txbuf[28] = 0x0;
-      txbuf[29] = 0x0;
-    }
+  // 受信データ確認
+  // バッファチェック　ID, SC
+  if ((rxbuf[0] != (0x40 | servolocalID)) || (rxbuf[1] != sccode)) {
+    // debugPrint("return data is incorrect.\r\n");
+    return RETCODE_ERROR_RETURNDATAWRONG;
   }
 
-  if (w_edata->temperaturelimit != EEPROM_NOTCHANGE) {
-    txbuf[30] = (uint8_t)(w_edata->temperaturelimit) >> 4;
-    txbuf[31] = (uint8_t)(w_edata->temperaturelimit) & 0b0000000000001111;
-  }
-  if (w_edata->currentlimit != EEPROM_NOTCHANGE) {
-    txbuf[32] = (uint8_t)(w_edata->currentlimit) >> 4;
-    txbuf[33] = (uint8_t)(w_edata->currentlimit) & 0b0000000000001111;
-  }
-  if (w_edata->response != EEPROM_NOTCHANGE) {
-    txbuf[52] = (uint8_t)(w_edata->response) >> 4;
-    txbuf[53] = (uint8_t)(w_edata->response) & 0b0000000000001111;
-  }
-  if (w_edata->offset !=
-      EEPROM_NOTCHANGE) { // ICSマネージャ挙動では、正負反対に収納されているのでそれに合わせる
-    uint8_t tmpoffset = ~(w_edata->offset) + 1;
-    txbuf[54] = (uint8_t)(tmpoffset) >> 4;
-    txbuf[55] = (uint8_t)(tmpoffset)&0b0000000000001111;
-  }
+  // IDが書き換わった場合、ICSバージョンのキャッシュは当てにならない
   if (w_edata->ID != EEPROM_NOTCHANGE) {
-    // IDは専用のコマンドがあるので、本来はそちらで行う。こちらから書き込んでも私の環境ではID書き換えできているが、リファレンスマニュアルには記載無し
-    txbuf[58] = (uint8_t)(w_edata->ID) >> 4;
-    txbuf[59] = (uint8_t)(w_edata->ID) & 0b0000000000001111;
+    clear_icsversion();
+    forget_param_written();
   }
 
-  if (w_edata->charstretch1 != EEPROM_NOTCHANGE) {
-    txbuf[60] = (uint8_t)(w_edata->charstretch1 * 2) >>
-                4; // 2倍値で収納されてるので処理
-    txbuf[61] = (uint8_t)(w_edata->charstretch1 * 2) & 0b0000000000001111;
+  return RETCODE_OK;
+}
+
+// EEPROM読み取り（省メモリ版）
+// 引数：　サーボＩＤ、省メモリ版設定構造体
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsCommunication::get_EEPROM(uint8_t servolocalID, IcsPackedConfig *r_cfg) {
+  uint8_t rxbuf[ICS_EEPROM_SIZE];
+
+  retcode = read_EEPROMraw(servolocalID, rxbuf);
+  if (retcode != RETCODE_OK) {
+    return retcode;
   }
-  if (w_edata->charstretch2 != EEPROM_NOTCHANGE) {
-    txbuf[62] = (uint8_t)(w_edata->charstretch2 * 2) >>
-                4; // 2倍値で収納されてるので処理
-    txbuf[63] = (uint8_t)(w_edata->charstretch2 * 2) & 0b0000000000001111;
+
+  return ics_decode_EEPROM_packed(rxbuf, r_cfg);
+}
+
+// EEPROM書き込み（省メモリ版）
+// 引数：　サーボＩＤ、省メモリ版設定構造体（mask の立っている項目のみ書き込む）
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+// 読み取りと書き込みで同じバッファを使い回す（スタック 66byte のみ）。
+int IcsCommunication::set_EEPROM(uint8_t servolocalID, IcsPackedConfig *w_cfg) {
+  uint8_t buf[ICS_EEPROM_SIZE];
+  uint8_t sccode = SC_CODE_EEPROM;
+
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
   }
-  if (w_edata->charstretch1 != EEPROM_NOTCHANGE) {
-    txbuf[64] = (uint8_t)(w_edata->charstretch3 * 2) >>
-                4; // 2倍値で収納されてるので処理
-    txbuf[65] = (uint8_t)(w_edata->charstretch3 * 2) & 0b0000000000001111;
+  // 値は ics_packed_set で範囲チェック済み
+
+  // 書き込む前に必ず最新のEEPROM読み取り！（ヘッダの0x5Aチェック込み）
+  retcode = read_EEPROMraw(servolocalID, buf);
+  if (retcode != RETCODE_OK) {
+    return retcode;
   }
 
-  // ICS送信
-  retcode = transceive(txbuf, rxbuf, txsize, rxsize);
+  // 読み取った内容に変更部分のみ上書きして、そのまま送信する
+  buf[0] = ICS_CMD_HEAD_WRITE | servolocalID;
+  buf[1] = sccode;
+  ics_encode_EEPROM_packed(buf, w_cfg);
 
+  // EEPROMを書き換えると、パラメータの書き込み済みの値は当てにならない
+  forget_param_written(1UL << servolocalID);
+  // ICS送信　書き込み完了まで返信が来ないので、タイムアウトを長くとる
+  retcode = transceive(buf, buf, ICS_EEPROM_SIZE, 2, TIMEOUT_EEPROMWRITE_US);
   if (retcode != RETCODE_OK) {
-    // debugPrint("error: " + String(retcode));
     return retcode;
   }
 
-  // 受信データ確認
   // バッファチェック　ID, SC
-  if ((rxbuf[0] != (0x40 | servolocalID)) || (rxbuf[1] != sccode)) {
-    // debugPrint("return data is incorrect.\r\n");
+  if ((buf[0] != (0x40 | servolocalID)) || (buf[1] != sccode)) {
     return RETCODE_ERROR_RETURNDATAWRONG;
   }
 
-  return RETCODE_OK;
-}
-
-// データがEEPROM用として正当かどうかを確認する関数
-// 元々のサーボ内の変更禁止バイト部分の読み込み等は別で行っている
-// 内容がEEPROM_NOTCHANGE（初期状態）だと、書き込み不適と判断しエラーを返す
-int IcsCommunication::check_EEPROMdata(EEPROMdata *edata) {
-  int checkdata;
-  int tmpretcode = RETCODE_OK;
-
-  checkdata = edata->stretch;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 1) || (checkdata > 127)) {
-    printf("EEPROMdata error: stretch\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->speed;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0x7F)) {
-    printf("EEPROMdata error: speed\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->punch;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x00) ||
-      (checkdata > 0x0A)) {
-    printf("EEPROMdata error: punch\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->deadband;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x00) ||
-      (checkdata > 0x10)) {
-    printf("EEPROMdata error: deadband\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->dumping;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0xFF)) {
-    printf("EEPROMdata error: dumping\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->safetimer;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0xFF)) {
-    printf("EEPROMdata error: safetimer\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-
-  // フラグ
-  if ((edata->flag_slave != EEPROM_NOTCHANGE) && (edata->flag_slave != 0) &&
-      (edata->flag_slave != 1)) {
-    printf("EEPROMdata error: flag_slave\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  if ((edata->flag_rotation != EEPROM_NOTCHANGE) &&
-      (edata->flag_rotation != 0) && (edata->flag_rotation != 1)) {
-    printf("EEPROMdata error: flag_rotation\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  if ((edata->flag_pwminh != EEPROM_NOTCHANGE) && (edata->flag_pwminh != 0) &&
-      (edata->flag_pwminh != 1)) {
-    printf("EEPROMdata error: flag_pwminh\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  if ((edata->flag_free != EEPROM_NOTCHANGE) && (edata->flag_free != 0) &&
-      (edata->flag_free != 1)) {
-    printf("EEPROMdata error: flag_free\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  if ((edata->flag_reverse != EEPROM_NOTCHANGE) && (edata->flag_reverse != 0) &&
-      (edata->flag_reverse != 1)) {
-    printf("EEPROMdata error: flag_reverse\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-
-  checkdata = edata->poslimithigh;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 8000) ||
-      (checkdata > POS_MAX)) {
-    printf("EEPROMdata error: poslimithigh\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->poslimitlow;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < POS_MIN) ||
-      (checkdata > 7000)) {
-    printf("EEPROMdata error: poslimitlow\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-
-  if ((edata->commspeed != EEPROM_NOTCHANGE) && (edata->commspeed != 115200) &&
-      (edata->commspeed != 625000) && (edata->commspeed != 1250000)) {
-    printf("EEPROMdata error: commspeed\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-
-  checkdata = edata->temperaturelimit;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0x7F)) {
-    printf("EEPROMdata error: temperaturelimit\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->currentlimit;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0x3F)) {
-    printf("EEPROMdata error: currentlimit\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->response;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x01) ||
-      (checkdata > 0x05)) {
-    printf("EEPROMdata error: response\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->offset;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < -128) ||
-      (checkdata > 127)) {
-    printf("EEPROMdata error: offset\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->ID;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 0x00) ||
-      (checkdata > 0x1F)) {
-    printf("EEPROMdata error: ID\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->charstretch1;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 1) || (checkdata > 127)) {
-    printf("EEPROMdata error: charstretch1\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->charstretch2;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 1) || (checkdata > 127)) {
-    printf("EEPROMdata error: charstretch2\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
-  }
-  checkdata = edata->charstretch3;
-  if ((checkdata != EEPROM_NOTCHANGE) && (checkdata < 1) || (checkdata > 127)) {
-    printf("EEPROMdata error: charstretch3\r\n");
-    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  // IDが書き換わった場合、ICSバージョンのキャッシュは当てにならない
+  if (ics_packed_isset(w_cfg, ICS_FIELD_ID)) {
+    clear_icsversion();
+    forget_param_written();
   }
 
-  return tmpretcode;
-}
-
-// 上位下位4bitずつに分かれた2byteを、1byteにして取得する関数
-uint8_t IcsCommunication::combine_2byte(uint8_t a, uint8_t b) {
-  return (uint8_t)((a << 4) | b);
+  return RETCODE_OK;
 }
 
 // バッファ内のEEPROM生バイトデータを表示する関数
@@ -1049,6 +1354,10 @@ int IcsCommunication::set_ID(uint8_t servolocalID) {
   txbuf[2] = 0x01;
   txbuf[3] = 0x01;
 
+  // IDが書き換わるので、ICSバージョンのキャッシュを破棄
+  clear_icsversion();
+  forget_param_written();
+
   // ICS送信
   retcode = transceive(txbuf, rxbuf, txsize, rxsize);
 
@@ -1,53 +1,46 @@
 #ifndef _ICS_COMMUNICATION_HPP_
 #define _ICS_COMMUNICATION_HPP_
 
+#include "IcsCodec.hpp"
+#include "IcsDefine.hpp"
+#include "IcsPackedConfig.hpp"
+#include "IcsTrace.hpp"
 #include "mbed.h"
 #include "stdint.h"
+#include <atomic>
 
-// 定数
-static const int ID_MIN = 0;
-static const int ID_MAX = 31;
-static const int ID_NUM = 32;
-
-static const int EEPROM_NOTCHANGE = -4096;
+// 送受信切り替え（ターンアラウンド）の計測結果（usec）
+struct IcsTurnaroundStats
+{
+  uint32_t count = 0;         // 計測した往復数
+  uint32_t turnaroundMin = 0; // 送信完了→受信準備完了
+  uint32_t turnaroundMax = 0;
+  uint32_t turnaroundSum = 0;
+  uint32_t replyMin = 0; // 送信完了→返信1バイト目（サーボの応答時間含む）
+  uint32_t replyMax = 0;
+  uint32_t replySum = 0;
+  uint32_t replyCount = 0; // 返信のあった往復数
+};
 
-static const int RETCODE_OK = 1;
-static const int RETCODE_ERROR_ICSREAD =
-    -1001;                                       // 読み取りエラー、おそらくタイムアウト
-static const int RETCODE_ERROR_ICSWRITE = -1002; // 返信コマンド内容エラー
-static const int RETCODE_ERROR_IDWRONG = -1003;
-static const int RETCODE_ERROR_OPTIONWRONG = -1004;
-static const int RETCODE_ERROR_RETURNDATAWRONG = -1005;
-static const int RETCODE_ERROR_EEPROMDATAWRONG = -1006;
+// 低消費電力待ちの計測結果（usec）
+struct IcsSleepStats
+{
+  uint32_t sleeps = 0;         // スリープ回数
+  uint32_t rxWakes = 0;        // 受信割り込みで起きた回数
+  uint32_t timerWakes = 0;     // 期限タイマで起きた回数
+  uint64_t sleepUs = 0;        // スリープしていた時間の合計
+  uint32_t wakeLatencyMax = 0; // 期限から復帰までの遅れ（タイマで起きた場合）
+  uint64_t wakeLatencySum = 0;
+};
 
-// IcsCommunicationクラスで用いるEEPROMデータ用構造体
-struct EEPROMdata
+// 非常脱力の結果
+struct IcsEmergencyResult
 {
-  int stretch = EEPROM_NOTCHANGE;
-  int speed = EEPROM_NOTCHANGE;
-  int punch = EEPROM_NOTCHANGE;
-  int deadband = EEPROM_NOTCHANGE;
-  int dumping = EEPROM_NOTCHANGE;
-  int safetimer = EEPROM_NOTCHANGE;
-
-  int flag_slave = EEPROM_NOTCHANGE;
-  int flag_rotation = EEPROM_NOTCHANGE;
-  int flag_pwminh = EEPROM_NOTCHANGE;
-  // ここを変更しても書き込まない（ICSマネージャによると、読み出し参照のみとのこと）
-  int flag_free = EEPROM_NOTCHANGE;
-  int flag_reverse = EEPROM_NOTCHANGE;
-
-  int poslimithigh = EEPROM_NOTCHANGE;
-  int poslimitlow = EEPROM_NOTCHANGE;
-  int commspeed = EEPROM_NOTCHANGE;
-  int temperaturelimit = EEPROM_NOTCHANGE;
-  int currentlimit = EEPROM_NOTCHANGE;
-  int response = EEPROM_NOTCHANGE;
-  int offset = EEPROM_NOTCHANGE;
-  int ID = EEPROM_NOTCHANGE;
-  int charstretch1 = EEPROM_NOTCHANGE;
-  int charstretch2 = EEPROM_NOTCHANGE;
-  int charstretch3 = EEPROM_NOTCHANGE;
+  uint32_t ackMask = 0;  // 返信のあったID（1 << ID）
+  uint32_t failMask = 0; // 再送しても返信の無かったID
+  int attempts = 0;      // 送信フレーム数
+  uint32_t elapsedUs = 0;
+  uint32_t boundUs = 0; // 最悪時間の計算値（elapsedUs はこれを超えない）
 };
 
 class IcsCommunication
@@ -56,18 +49,72 @@ class IcsCommunication
 public:
   // プライベート変数
 private:
-  static const int POS_MIN = 3500;
-  static const int POS_MAX = 11500;
   static const int SC_CODE_EEPROM = 0x00;
   static const int SC_CODE_STRETCH = 0x01;
   static const int SC_CODE_SPEED = 0x02;
   static const int SC_CODE_CURRENT = 0x03;
   static const int SC_CODE_TEMPERATURE = 0x04;
+  static const int SC_CODE_POSITION = 0x05; // ICS3.6のみ
+
+  // 返信待ちタイムアウト（最後に受信してからの時間, usec）
+  static const uint32_t TIMEOUT_DEFAULT_US = 10000;
+  static const uint32_t TIMEOUT_EEPROMWRITE_US = 1000000;
+
+  // 8bit + EVEN + スタート・ストップビットで 1文字 11bit
+  static const uint32_t BITS_PER_CHAR = 11;
+  // write() から戻った時点で送信中の可能性がある文字数
+  // （送信データレジスタ + シフトレジスタ）
+  static const int TX_TAIL_CHARS_DEFAULT = 2;
 
   UnbufferedSerial *refSer;
   DigitalOut icsPin;
   uint32_t baudrate = 115200;
   bool initHigh;
+  uint32_t timeoutUs = TIMEOUT_DEFAULT_US;
+
+  // 送信完了待ち　レジスタ指定が無ければ文字時間から計算して待つ
+  volatile uint32_t *txStatusReg = nullptr;
+  uint32_t txCompleteMask = 0;
+  int txTailChars = TX_TAIL_CHARS_DEFAULT;
+  IcsTurnaroundStats turnaround;
+
+  // 低消費電力待ち
+  // 残り時間がこれより短ければスリープせずに待つ（復帰の遅れの方が大きいため）
+  static const uint32_t SLEEP_MIN_US_DEFAULT = 50;
+  bool lowPower = false;
+  uint32_t sleepMinUs = SLEEP_MIN_US_DEFAULT;
+  Timeout wakeTimer;
+  volatile bool rxWake = false;
+  volatile bool timerWake = false;
+  IcsSleepStats sleepStats;
+  uint64_t cycleSleepMark = 0;
+
+  // 非常脱力
+  // 脱力フレーム送信後、返信を待つ時間（送信完了から、返信3バイト分の時間を除く）
+  static const uint32_t EMERGENCY_WINDOW_US_DEFAULT = 1000;
+  // バスの空き待ちで、相手スレッドが動いて（中断して）抜けるまでの余裕
+  // 同じ優先度のときのタイムスライス（RTXの既定 5msec）+ 1msec待ちの切り上げ
+  // + ティック1つ分
+  static const uint32_t EMERGENCY_SCHED_US = 7000;
+  // 取り合いは「自分のフラグを立ててから相手のフラグを見る」順にする（seq_cst）
+  // ので、transceive と emergency_free_all が同時にバスを使うことは無い
+  std::atomic<bool> emergency{false}; // 立っている間、通常の通信は中断・拒否する
+  std::atomic<bool> busy{false};      // バス使用中（transceive、非常脱力の送信）
+  // 非常脱力中に transceive がバスを放したことの通知
+  Semaphore busFree{0, 1};
+  uint32_t emergencyWindowUs = EMERGENCY_WINDOW_US_DEFAULT;
+
+  // 通信記録
+  IcsTrace *trace = nullptr;
+  uint32_t txDoneTime = 0;
+  int rxCount = 0;
+
+  // ID毎のICSバージョン検出結果キャッシュ（ICS_VERSION_UNKNOWN は未検出）
+  uint8_t icsVersion[ID_NUM] = {};
+
+  // ID毎のパラメータ（stretch, speed, 電流制限, 温度制限）の書き込み済みの値
+  // write_Param の成功・失敗、stretch/speed の読み取りで更新する（0 は不明）
+  uint8_t paramWritten[ID_NUM][4] = {};
 
   int retcode;
   int retval;
@@ -78,7 +125,48 @@ public:
 
   // 初期化
   bool begin(uint32_t brate = 115200, bool initFlag = true);
+  // 複数バスの初期化　550msecウェイトを全バス同時に行う
+  static bool begin_parallel(IcsCommunication *const *icslist, int num,
+                             uint32_t brate = 115200, bool initFlag = true);
   void change_baudrate(uint32_t brate);
+  uint32_t get_baudrate();
+  void set_timeout(uint32_t us);
+  uint32_t get_timeout();
+  void set_trace(IcsTrace *tr);
+
+  // 送受信切り替え　送信完了（最後のストップビット）を待ってから受信に切り替える
+  //  status_reg: UARTの状態レジスタ（例 &USART2->SR）、tc_mask: 送信完了ビット
+  //  （例 USART_SR_TC）。nullptr なら write() 後に tail_chars 文字分の時間を待つ。
+  void set_tx_complete_flag(volatile uint32_t *status_reg, uint32_t tc_mask);
+  void set_tx_tail(int tail_chars);
+  const IcsTurnaroundStats *get_turnaround_stats();
+  void reset_turnaround_stats();
+
+  // 低消費電力待ち　返信の1バイト目を待つ間、受信割り込みか期限タイマまでスリープする
+  // （1バイト目以降はフレームの終わりまでポーリング）
+  void set_low_power(bool en, uint32_t sleep_min_us = SLEEP_MIN_US_DEFAULT);
+  // フレーム間の空き時間用　deadline_us（us_ticker_read の値）までスリープ
+  void idle_until(uint32_t deadline_us);
+  const IcsSleepStats *get_sleep_stats();
+  void reset_sleep_stats();
+  uint32_t take_cycle_sleep_us(); // 前回呼んでからのスリープ時間
+
+  // 非常脱力　全サーボを最短の間隔で脱力させる
+  //  request_abort: 割り込みからも呼べる。通信中の往復を中断し、以後の通信を拒否する
+  //  emergency_free_all: スレッドから呼ぶ。idmask の全IDに脱力を送り、
+  //  返信の無いIDには retries 回まで再送する。最悪でも emergency_bound_us で終わる。
+  //  他スレッドが通信中なら、スリープしてそのスレッドに往復を中断させ、バスが
+  //  放されるのを待つ（呼び出し側の優先度が高くても低くてもよい）。
+  //  両者の間の優先度のスレッドがCPUを使い続けるなどで、時間内に放されない
+  //  場合だけは、何も送らずに RETCODE_ERROR_BUSBUSY を返す。
+  //  通常の通信に戻すには clear_emergency を呼ぶ。
+  void request_abort();
+  int emergency_free_all(uint32_t idmask = 0xFFFFFFFF, int retries = 2,
+                         IcsEmergencyResult *result = nullptr);
+  uint32_t emergency_bound_us(uint32_t idmask, int retries);
+  void set_emergency_window(uint32_t window_us);
+  void clear_emergency();
+  bool is_emergency();
 
   // サーボ移動関係
   int set_position(uint8_t servolocalID,
@@ -87,6 +175,20 @@ public:
       uint8_t servolocalID); // サーボ脱力する　　　　　位置が戻り値として来る
   int set_position_weakandkeep(
       uint8_t servolocalID); // サーボ脱力後即動作する　位置が戻り値として来る
+  int get_position(
+      uint8_t servolocalID); // 現在位置取得　ICS3.6なら専用コマンドを使う
+
+  // ICSバージョン検出　結果はIDごとにキャッシュされる
+  int get_icsversion(uint8_t servolocalID);
+  int get_icsversion_cached(uint8_t servolocalID); // 検出はしない
+  void clear_icsversion();
+
+  // パラメータの書き込み済みの値（このクラスを通した書き込み・読み取りで更新）
+  //  sccode: 1 stretch, 2 speed, 3 電流制限, 4 温度制限
+  // 戻り値に値、または不明なら 0。サーボの電源を入れ直したときや、他の経路で
+  // 書き込んだときは forget_param_written を呼ぶこと。
+  int get_param_written(uint8_t servolocalID, uint8_t sccode);
+  void forget_param_written(uint32_t idmask = 0xFFFFFFFF);
 
   // パラメータ関数系　電源切ると設定消える
   int get_stretch(uint8_t servolocalID);
@@ -102,6 +204,13 @@ public:
   // EEPROM系　電源切っても設定消えない
   int get_EEPROM(uint8_t servolocalID, EEPROMdata *r_edata);
   int set_EEPROM(uint8_t servolocalID, EEPROMdata *w_edata);
+  // 省メモリ版　EEPROMdata を経由せず生バイトと直接変換する
+  int get_EEPROM(uint8_t servolocalID, IcsPackedConfig *r_cfg);
+  int set_EEPROM(uint8_t servolocalID, IcsPackedConfig *w_cfg);
+  // 生バイト（66byte）　応答の不安定なサーボの設定を戻す場合など、
+  // 書き込み前に読み取りができないときは、以前読んだ内容を直して書き込む
+  int read_EEPROMraw(uint8_t servolocalID, uint8_t *rxbuf);
+  int write_EEPROMraw(uint8_t servolocalID, const uint8_t *image);
 
   void show_EEPROMbuffer(uint8_t *checkbuf);
   void show_EEPROMdata(EEPROMdata *edata);
@@ -115,12 +224,22 @@ public:
   // プライベート関数
 private:
   int transceive(uint8_t *txbuf, uint8_t *rxbuf, uint8_t txsize,
-                 uint8_t rxsize);
+                 uint8_t rxsize, uint32_t timeout = 0);
+  int transceive_bus(uint8_t *txbuf, uint8_t *rxbuf, uint8_t txsize,
+                     uint8_t rxsize, uint32_t timeout);
+  uint32_t wait_tx_complete(uint8_t txsize);
+  void add_turnaround(uint32_t txend, uint32_t rxready, uint32_t firstbyte,
+                      bool replied);
+  void sleep_until(uint32_t deadline_us, bool wake_on_rx);
+  void on_rx_irq();
+  void on_wake_timer();
+  uint32_t char_us();
+  bool emergency_free(uint8_t servolocalID);
+  uint32_t emergency_inflight_us();
+  uint32_t emergency_wait_us();
+  int read_position(uint8_t servolocalID);
   int read_Param(uint8_t servolocalID, uint8_t sccode);
   int write_Param(uint8_t servolocalID, uint8_t sccode, int val);
-  int read_EEPROMraw(uint8_t servolocalID, uint8_t *rxbuf);
-  int check_EEPROMdata(EEPROMdata *edata);
-  uint8_t combine_2byte(uint8_t a, uint8_t b);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "IcsCompliance.hpp"
+
+// コンストラクタ
+IcsCompliance::IcsCompliance(IcsCommunication &icsref) { ics = &icsref; }
+
+// 柔軟制御するサーボの登録
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsCompliance::add_servo(uint8_t servolocalID, int target, int stiffness,
+                             int damping, int stretch_max, int stretch_min) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((stretch_min < 1) || (stretch_max > 127) || (stretch_min > stretch_max)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsComplianceState *st = &state[servolocalID];
+  // 登録前の stretch（登録し直しの場合は最初の登録前の値を引き継ぐ）
+  int saved = st->registered
+                  ? st->stretchSaved
+                  : ics->get_param_written(servolocalID, ICS_SC_STRETCH);
+  *st = IcsComplianceState();
+  st->stretchSaved = saved;
+  st->stretchMax = stretch_max;
+  st->stretchMin = stretch_min;
+  if (set_target(servolocalID, target) != RETCODE_OK) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if (set_gain(servolocalID, stiffness, damping) != RETCODE_OK) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  st->registered = true;
+
+  return RETCODE_OK;
+}
+
+// 登録解除　stretch は登録前の値に戻す（不明なら登録時の最大値）
+void IcsCompliance::remove_servo(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return;
+  }
+  IcsComplianceState *st = &state[servolocalID];
+  if (st->registered) {
+    if (st->stretchSaved > 0) {
+      // 一度も書き込んでいなければ、登録前の値のまま
+      if ((st->stretchNow != -1) && (st->stretchNow != st->stretchSaved)) {
+        ics->set_stretch(servolocalID, st->stretchSaved);
+      }
+    } else if (st->stretchNow != st->stretchMax) {
+      ics->set_stretch(servolocalID, st->stretchMax);
+    }
+  }
+  st->registered = false;
+}
+
+// 目標位置の変更
+int IcsCompliance::set_target(uint8_t servolocalID, int target) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((target < POS_MIN) || (target > POS_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  state[servolocalID].target = target;
+  return RETCODE_OK;
+}
+
+// 剛性・粘性の変更（0-256）
+int IcsCompliance::set_gain(uint8_t servolocalID, int stiffness, int damping) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((stiffness < 0) || (stiffness > GAIN_ONE) || (damping < 0) ||
+      (damping > GAIN_ONE)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsComplianceState *st = &state[servolocalID];
+  st->stiffness = stiffness;
+  st->damping = damping;
+  calc_stretch(st);
+  return RETCODE_OK;
+}
+
+// 電流による stretch 低減の設定（閾値はICS電流値 0-63）
+void IcsCompliance::set_current_yield(int threshold, int gain) {
+  currentThreshold = threshold;
+  currentGain = gain;
+}
+
+// メインループ処理
+// 戻り値にこの回の通信エラー数が入ります。
+int IcsCompliance::update() {
+  int errnum = 0;
+
+  // ループ周期の計測（1/8 の指数平滑）
+  uint32_t now = us_ticker_read();
+  if (lastTime != 0) {
+    uint32_t dt = now - lastTime;
+    periodUs = (periodUs == 0) ? dt : (periodUs * 7 + dt) / 8;
+  }
+  lastTime = now;
+
+  for (int id = 0; id < ID_NUM; id++) {
+    IcsComplianceState *st = &state[id];
+    if (!st->registered) {
+      continue;
+    }
+
+    int cmd = calc_command(st);
+    int pos = ics->set_position(id, cmd);
+    st->command = cmd;
+    if (pos < 0) {
+      st->errorCount++;
+      errnum++;
+      continue;
+    }
+
+    // 速度（Q4）　1/4 の指数平滑
+    if (st->position >= 0) {
+      int dv = (pos - st->position) * (1 << VELOCITY_SHIFT) - st->velocity;
+      st->velocity += dv / 4;
+    }
+    st->position = pos;
+  }
+
+  if (side_transaction() < 0) {
+    errnum++;
+  }
+
+  return errnum;
+}
+
+const IcsComplianceState *IcsCompliance::get_state(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return nullptr;
+  }
+  return &state[servolocalID];
+}
+
+uint32_t IcsCompliance::get_period_us() { return periodUs; }
+
+// 指令位置の計算
+int IcsCompliance::calc_command(IcsComplianceState *st) {
+  // 現在位置が未取得なら目標をそのまま送る
+  if (st->position < 0) {
+    return st->target;
+  }
+
+  int deflection = st->position - st->target;
+  int cmd = st->target + deflection * (GAIN_ONE - st->stiffness) / GAIN_ONE -
+            st->velocity * st->damping / (GAIN_ONE << VELOCITY_SHIFT);
+
+  if (cmd < POS_MIN) {
+    cmd = POS_MIN;
+  } else if (cmd > POS_MAX) {
+    cmd = POS_MAX;
+  }
+  return cmd;
+}
+
+// 書き込みたい stretch の計算　剛性に比例させ、過電流分をさらに下げる
+void IcsCompliance::calc_stretch(IcsComplianceState *st) {
+  int range = st->stretchMax - st->stretchMin;
+  int stretch = st->stretchMin + range * st->stiffness / GAIN_ONE;
+
+  int cur = (st->current < 0) ? -st->current : st->current;
+  if (cur > currentThreshold) {
+    stretch -= (cur - currentThreshold) * currentGain;
+  }
+  if (stretch < st->stretchMin) {
+    stretch = st->stretchMin;
+  }
+  st->stretchWant = stretch;
+}
+
+// 追加の1往復　stretch の書き込み待ちがあれば優先、無ければ電流を読む
+// 戻り値に通信したID、通信無しなら 0 以上の値、エラーなら負の値
+int IcsCompliance::side_transaction() {
+  for (int n = 0; n < ID_NUM; n++) {
+    IcsComplianceState *st = &state[(sideIndex + n) % ID_NUM];
+    if (st->registered && (st->stretchWant != st->stretchNow)) {
+      int id = (sideIndex + n) % ID_NUM;
+      sideIndex = (id + 1) % ID_NUM;
+      int ret = ics->set_stretch(id, st->stretchWant);
+      if (ret != RETCODE_OK) {
+        st->errorCount++;
+        return ret;
+      }
+      st->stretchNow = st->stretchWant;
+      return id;
+    }
+  }
+
+  for (int n = 0; n < ID_NUM; n++) {
+    int id = (sideIndex + n) % ID_NUM;
+    IcsComplianceState *st = &state[id];
+    if (!st->registered) {
+      continue;
+    }
+    sideIndex = (id + 1) % ID_NUM;
+    int val = ics->get_current(id);
+    if (val < 0) {
+      st->errorCount++;
+      return val;
+    }
+    // 64以上は逆方向の電流
+    st->current = (val >= 64) ? -(val - 64) : val;
+    calc_stretch(st);
+    return id;
+  }
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef _ICS_COMPLIANCE_HPP_
+#define _ICS_COMPLIANCE_HPP_
+
+#include "IcsCommunication.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// ソフトウェア柔軟制御（インピーダンス制御）
+// update() をメインループでできるだけ速く呼ぶ。1回あたり、
+//  ・登録サーボ全てに set_position（返信の現在位置をそのまま帰還に使う）
+//  ・追加で1往復だけ、stretch の書き込み（変更がある場合）か電流読み取り
+// を行う。set_position_weak との切り替えは不要。
+//
+// 指令値 = 目標 + 変位 × (256 - 剛性) / 256 - 速度 × 粘性 / 256
+//  剛性 256 で目標を保持し、0 で外力に押された位置にそのまま従う。
+//  粘性は動いている方向と逆に指令をずらし、動きを滑らかにする。
+// さらに剛性に応じて stretch（サーボ自身の保持力）を下げ、
+// 電流が閾値を超えたら stretch をさらに下げて外力に逃げる。
+// 計算は整数のみ（FPU不要）。
+
+// IDごとの状態
+struct IcsComplianceState
+{
+  bool registered = false;
+  int target = POS_CENTER; // 目標位置（外力の無いときの位置）
+  int stiffness = 256;     // 剛性 0-256
+  int damping = 0;         // 粘性 0-256
+  int stretchMax = 60;     // 剛性 256 のときの stretch
+  int stretchMin = 10;     // 剛性 0 または過電流時の stretch
+
+  int position = -1;   // 最新の現在位置（未取得は -1）
+  int velocity = 0;    // 速度（カウント/周期、Q4 固定小数点、平滑化済み）
+  int current = 0;     // 最新の電流（逆方向は負）
+  int command = -1;    // 最後に送った指令位置
+  int stretchNow = -1; // 書き込み済みの stretch（未書き込みは -1）
+  int stretchWant = 0; // 書き込みたい stretch
+  int stretchSaved = 0; // 登録前の stretch（登録解除で戻す、不明は 0）
+  int errorCount = 0;  // 通信エラー回数（累計）
+};
+
+class IcsCompliance
+{
+  // パブリック変数
+public:
+  static const int GAIN_ONE = 256;
+  static const int VELOCITY_SHIFT = 4; // velocity の小数部ビット数
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+  IcsComplianceState state[ID_NUM];
+  int sideIndex = 0; // 追加の1往復を割り当てる次のID
+
+  // 電流による stretch 低減（ICS電流値 0-63）
+  int currentThreshold = 20;
+  int currentGain = 2; // 閾値超過 1 あたりの stretch 低減量
+
+  // ループ周期の計測
+  uint32_t lastTime = 0;
+  uint32_t periodUs = 0; // 平滑化した周期
+
+  // パブリック関数
+public:
+  IcsCompliance(IcsCommunication &icsref);
+
+  // 登録・設定　剛性・粘性は 0-256
+  int add_servo(uint8_t servolocalID, int target, int stiffness, int damping,
+                int stretch_max = 60, int stretch_min = 10);
+  void remove_servo(uint8_t servolocalID);
+  int set_target(uint8_t servolocalID, int target);
+  int set_gain(uint8_t servolocalID, int stiffness, int damping);
+  void set_current_yield(int threshold, int gain);
+
+  // メインループで呼ぶ　戻り値にこの回の通信エラー数
+  int update();
+
+  // 状態取得
+  const IcsComplianceState *get_state(uint8_t servolocalID);
+  uint32_t get_period_us(); // 平滑化したループ周期
+
+  // プライベート関数
+private:
+  int calc_command(IcsComplianceState *st);
+  void calc_stretch(IcsComplianceState *st);
+  int side_transaction();
+};
+
+#endif
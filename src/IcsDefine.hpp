@@ -0,0 +1,69 @@
+#ifndef _ICS_DEFINE_HPP_
+#define _ICS_DEFINE_HPP_
+
+// mbedに依存しない共通定義
+// ホスト（PC）側のツールからも読み込めるよう、ここには定数と構造体のみ置く
+
+#include "stdint.h"
+
+// 定数
+static const int ID_MIN = 0;
+static const int ID_MAX = 31;
+static const int ID_NUM = 32;
+
+static const int POS_MIN = 3500;
+static const int POS_CENTER = 7500;
+static const int POS_MAX = 11500;
+
+static const int EEPROM_NOTCHANGE = -4096;
+
+static const int RETCODE_OK = 1;
+static const int RETCODE_ERROR_ICSREAD =
+    -1001;                                       // 読み取りエラー、おそらくタイムアウト
+static const int RETCODE_ERROR_ICSWRITE = -1002; // 返信コマンド内容エラー
+static const int RETCODE_ERROR_IDWRONG = -1003;
+static const int RETCODE_ERROR_OPTIONWRONG = -1004;
+static const int RETCODE_ERROR_RETURNDATAWRONG = -1005;
+static const int RETCODE_ERROR_EEPROMDATAWRONG = -1006;
+// -1007 は IcsBusPlanner.hpp（RETCODE_ERROR_BUSOVERRUN）
+static const int RETCODE_ERROR_ABORTED = -1008; // 非常停止で通信を中断した
+static const int RETCODE_ERROR_BUSBUSY = -1009; // 他の往復がバスを使用中
+
+// サーボごとのICS規格バージョン（get_icsversionの戻り値）
+static const int ICS_VERSION_UNKNOWN = 0;
+static const int ICS_VERSION_35 = 35;
+static const int ICS_VERSION_36 = 36;
+// 3.5と判定するのに必要な、3.6コマンド無応答 + 3.5コマンド応答の連続回数
+static const int ICS_PROBE35_CONFIRM = 3;
+
+// IcsCommunicationクラスで用いるEEPROMデータ用構造体
+struct EEPROMdata
+{
+  int stretch = EEPROM_NOTCHANGE;
+  int speed = EEPROM_NOTCHANGE;
+  int punch = EEPROM_NOTCHANGE;
+  int deadband = EEPROM_NOTCHANGE;
+  int dumping = EEPROM_NOTCHANGE;
+  int safetimer = EEPROM_NOTCHANGE;
+
+  int flag_slave = EEPROM_NOTCHANGE;
+  int flag_rotation = EEPROM_NOTCHANGE;
+  int flag_pwminh = EEPROM_NOTCHANGE;
+  // ここを変更しても書き込まない（ICSマネージャによると、読み出し参照のみとのこと）
+  int flag_free = EEPROM_NOTCHANGE;
+  int flag_reverse = EEPROM_NOTCHANGE;
+
+  int poslimithigh = EEPROM_NOTCHANGE;
+  int poslimitlow = EEPROM_NOTCHANGE;
+  int commspeed = EEPROM_NOTCHANGE;
+  int temperaturelimit = EEPROM_NOTCHANGE;
+  int currentlimit = EEPROM_NOTCHANGE;
+  int response = EEPROM_NOTCHANGE;
+  int offset = EEPROM_NOTCHANGE;
+  int ID = EEPROM_NOTCHANGE;
+  int charstretch1 = EEPROM_NOTCHANGE;
+  int charstretch2 = EEPROM_NOTCHANGE;
+  int charstretch3 = EEPROM_NOTCHANGE;
+};
+
+#endif
\ No newline at end of file
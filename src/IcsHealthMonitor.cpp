@@ -0,0 +1,246 @@
+#include "IcsHealthMonitor.hpp"
+
+// コンストラクタ
+IcsHealthMonitor::IcsHealthMonitor(IcsCommunication &icsref) {
+  ics = &icsref;
+}
+
+// 監視対象の登録（通常時の stretch/speed をサーボから読み取る）
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsHealthMonitor::add_servo(uint8_t servolocalID) {
+  int stretch = ics->get_stretch(servolocalID);
+  if (stretch < 0) {
+    return stretch;
+  }
+  int speed = ics->get_speed(servolocalID);
+  if (speed < 0) {
+    return speed;
+  }
+  return add_servo(servolocalID, stretch, speed);
+}
+
+// 監視対象の登録（通常時の stretch/speed を指定）
+int IcsHealthMonitor::add_servo(uint8_t servolocalID, int stretch, int speed) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((stretch < 1) || (stretch > 127) || (speed < 1) || (speed > 127)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsHealthState *st = &state[servolocalID];
+  *st = IcsHealthState();
+  st->registered = true;
+  st->stretch = stretch;
+  st->speed = speed;
+  st->stretchNow = stretch;
+  st->speedNow = speed;
+  // 読み取り時刻をIDごとにずらして、バスの負荷を分散する
+  st->nextPoll =
+      us_ticker_read() + (intervalNormal / ID_NUM) * servolocalID;
+
+  return RETCODE_OK;
+}
+
+// 監視対象から外す　低減中なら通常時の値に戻す（stretch/speed で最大2往復）
+void IcsHealthMonitor::remove_servo(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return;
+  }
+  IcsHealthState *st = &state[servolocalID];
+  if (st->registered) {
+    st->derate = 0;
+    for (int a = 0; (a < 2) && apply_derate(servolocalID, st); a++) {
+    }
+  }
+  st->registered = false;
+  pendingMask &= ~(1UL << servolocalID);
+}
+
+// 温度閾値（ICS生値、小さいほど高温）
+void IcsHealthMonitor::set_temperature_threshold(int warm, int hot) {
+  tempWarm = warm;
+  tempHot = hot;
+}
+
+// 電流閾値（ICS生値 0-63）
+void IcsHealthMonitor::set_current_threshold(int warm, int hot) {
+  currentWarm = warm;
+  currentHot = hot;
+}
+
+// 読み取り間隔（通常時、注意・危険時）
+void IcsHealthMonitor::set_interval(uint32_t normal_us, uint32_t warm_us) {
+  intervalNormal = normal_us;
+  intervalWarm = warm_us;
+}
+
+// 最大低減時の stretch/speed
+void IcsHealthMonitor::set_derate_limit(int stretch_min, int speed_min) {
+  stretchMin = stretch_min;
+  speedMin = speed_min;
+}
+
+// 状態取得　未登録のIDでも内容は返す（registered で判別）
+const IcsHealthState *IcsHealthMonitor::get_state(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return nullptr;
+  }
+  return &state[servolocalID];
+}
+
+// 制御周期ごとの処理
+// 書き込みの残っているサーボがあれば、その1フレームだけを書き込む。
+// 無ければ読み取り時刻の来ているサーボを1つだけ選び、温度か電流を交互に読む。
+// 戻り値に通信したID、通信無しなら -1 が入ります。
+int IcsHealthMonitor::update() {
+  uint32_t now = us_ticker_read();
+
+  if (pendingMask != 0) {
+    int id = __builtin_ctz(pendingMask);
+    IcsHealthState *st = &state[id];
+    // 失敗した場合は次の読み取りまで再送しない（応答の無いサーボでバスを塞がない）
+    if (!apply_derate(id, st) || !derate_target(st, nullptr, nullptr)) {
+      pendingMask &= ~(1UL << id);
+    }
+    return id;
+  }
+
+  for (int n = 0; n < ID_NUM; n++) {
+    int id = (nextIndex + n) % ID_NUM;
+    IcsHealthState *st = &state[id];
+    if (!st->registered || ((int32_t)(now - st->nextPoll) < 0)) {
+      continue;
+    }
+    nextIndex = (id + 1) % ID_NUM;
+
+    int val;
+    if (st->pollCurrent) {
+      val = ics->get_current(id);
+      if (val >= 0) {
+        // 64以上は逆方向の電流
+        st->current = (val >= 64) ? (val - 64) : val;
+      }
+    } else {
+      val = ics->get_temperature(id);
+      if (val >= 0) {
+        st->temperature = val;
+      }
+    }
+    st->pollCurrent = !st->pollCurrent;
+
+    if (val < 0) {
+      st->errorCount++;
+    } else {
+      sync_nominal(id, st);
+      st->level = classify(st);
+      if ((st->level == ICS_HEALTH_HOT) && (st->derate < DERATE_STEPS)) {
+        st->derate++;
+      } else if ((st->level == ICS_HEALTH_NORMAL) && (st->derate > 0)) {
+        st->derate--;
+      }
+      // 書き込みは次回以降の update() で行う
+      // 前回の書き込みに失敗していた場合もここで再送される
+      if (derate_target(st, nullptr, nullptr)) {
+        pendingMask |= 1UL << id;
+      }
+    }
+
+    // 注意以上、または低減中は短い間隔で監視
+    if ((st->level != ICS_HEALTH_NORMAL) || (st->derate > 0)) {
+      st->nextPoll = now + intervalWarm;
+    } else {
+      st->nextPoll = now + intervalNormal / 2; // 温度と電流で2回
+    }
+    return id;
+  }
+
+  return -1;
+}
+
+// 温度・電流から状態を判定　悪い方を採用
+int IcsHealthMonitor::classify(IcsHealthState *st) {
+  int level = ICS_HEALTH_NORMAL;
+
+  if (st->temperature >= 0) {
+    if (st->temperature <= tempHot) {
+      level = ICS_HEALTH_HOT;
+    } else if (st->temperature <= tempWarm) {
+      level = ICS_HEALTH_WARM;
+    }
+  }
+  if ((st->current >= 0) && (level != ICS_HEALTH_HOT)) {
+    if (st->current >= currentHot) {
+      level = ICS_HEALTH_HOT;
+    } else if (st->current >= currentWarm) {
+      level = ICS_HEALTH_WARM;
+    }
+  }
+
+  return level;
+}
+
+// 通常時の値を、他から書き込まれた値に合わせる
+// 書き込み済みの値が、自分が最後に書いた値と違えば（プロファイル切り替え等）、
+// それを新しい通常時の値とする。低減中なら、その値から下げ直す。
+void IcsHealthMonitor::sync_nominal(uint8_t servolocalID, IcsHealthState *st) {
+  int s = ics->get_param_written(servolocalID, ICS_SC_STRETCH);
+  if ((s > 0) && (s != st->stretchNow)) {
+    st->stretch = s;
+    st->stretchNow = s;
+  }
+  int v = ics->get_param_written(servolocalID, ICS_SC_SPEED);
+  if ((v > 0) && (v != st->speedNow)) {
+    st->speed = v;
+    st->speedNow = v;
+  }
+}
+
+// 低減段階に応じた stretch/speed
+// 戻り値に、書き込み済みの値と違う（書き込みが必要な）場合は true が入ります。
+bool IcsHealthMonitor::derate_target(IcsHealthState *st, int *stretch,
+                                     int *speed) {
+  int smin = (stretchMin < st->stretch) ? stretchMin : st->stretch;
+  int vmin = (speedMin < st->speed) ? speedMin : st->speed;
+  int s = st->stretch - (st->stretch - smin) * st->derate / DERATE_STEPS;
+  int v = st->speed - (st->speed - vmin) * st->derate / DERATE_STEPS;
+
+  if (stretch != nullptr) {
+    *stretch = s;
+  }
+  if (speed != nullptr) {
+    *speed = v;
+  }
+  return (s != st->stretchNow) || (v != st->speedNow);
+}
+
+// 低減段階に応じた stretch/speed を1フレームだけ書き込む（変わった値のみ、
+// stretch が先）
+// 戻り値に、書き込みに成功した場合は true が入ります。
+bool IcsHealthMonitor::apply_derate(uint8_t servolocalID, IcsHealthState *st) {
+  int stretch, speed;
+  sync_nominal(servolocalID, st);
+  derate_target(st, &stretch, &speed);
+
+  int ret;
+  if (stretch != st->stretchNow) {
+    ret = ics->set_stretch(servolocalID, stretch);
+    if (ret == RETCODE_OK) {
+      st->stretchNow = stretch;
+    }
+  } else if (speed != st->speedNow) {
+    ret = ics->set_speed(servolocalID, speed);
+    if (ret == RETCODE_OK) {
+      st->speedNow = speed;
+    }
+  } else {
+    return false;
+  }
+
+  if (ret != RETCODE_OK) {
+    st->errorCount++;
+    return false;
+  }
+  return true;
+}
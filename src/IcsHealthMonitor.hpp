@@ -0,0 +1,99 @@
+#ifndef _ICS_HEALTH_MONITOR_HPP_
+#define _ICS_HEALTH_MONITOR_HPP_
+
+#include "IcsCommunication.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// サーボの温度・電流監視と自動出力低減（ディレーティング）
+// update() を制御周期ごとに呼ぶと、1回あたり最大1往復だけ温度か電流を読む。
+// 低減による stretch/speed の書き込みも1回に1フレームずつとし、書き込みが
+// 残っている間は読み取りより先に行う（どの update() も1往復を超えない）。
+// 各サーボの読み取りは時間をずらして分散し、限界に近いサーボは短い間隔で読む。
+// 高温・過電流のサーボは stretch/speed を段階的に下げ、冷えたら段階的に戻す。
+// 戻す先（通常時の値）は、IcsCommunication の書き込み済みの値
+// （get_param_written）に自分以外が書いた値があれば、それに合わせる。
+// IcsParamProfile 等で切り替えた値を、低減からの回復で上書きしないため。
+// （EEPROMではなくパラメータ書き込みなので、電源を切ると元に戻る）
+//
+// 注意：ICSの温度値は、温度が高いほど値が小さくなる。
+
+// 状態
+static const int ICS_HEALTH_NORMAL = 0; // 通常　低減を戻していく
+static const int ICS_HEALTH_WARM = 1;   // 注意　低減段階を保持、短い間隔で監視
+static const int ICS_HEALTH_HOT = 2;    // 危険　低減を進める
+
+// IDごとの状態
+struct IcsHealthState
+{
+  bool registered = false;
+  int temperature = -1; // 最新の温度値（未取得は -1）
+  int current = -1;     // 最新の電流値（回転方向を除いた 0-63、未取得は -1）
+  int level = ICS_HEALTH_NORMAL;
+  int derate = 0;      // 低減段階 0（低減なし）- DERATE_STEPS
+  int stretch = 0;     // 通常時の stretch（他から書き込まれたら追従）
+  int speed = 0;       // 通常時の speed（同上）
+  int stretchNow = 0;  // 現在書き込んでいる stretch
+  int speedNow = 0;    // 現在書き込んでいる speed
+  int errorCount = 0;  // 読み書きエラー回数（累計）
+  uint32_t nextPoll = 0;
+  bool pollCurrent = false; // 次回読むのが電流か
+};
+
+class IcsHealthMonitor
+{
+  // パブリック変数
+public:
+  static const int DERATE_STEPS = 8;
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+  IcsHealthState state[ID_NUM];
+  int nextIndex = 0;
+  uint32_t pendingMask = 0; // stretch/speed の書き込みが残っているID
+
+  // 閾値（ICS生値）　温度は小さいほど高温
+  int tempWarm = 50;
+  int tempHot = 40;
+  int currentWarm = 30;
+  int currentHot = 45;
+
+  // 読み取り間隔（usec）
+  uint32_t intervalNormal = 1000000;
+  uint32_t intervalWarm = 100000;
+
+  // 最大低減時の stretch/speed
+  int stretchMin = 10;
+  int speedMin = 20;
+
+  // パブリック関数
+public:
+  IcsHealthMonitor(IcsCommunication &icsref);
+
+  // 監視対象の登録　通常時の stretch/speed はサーボから読み取る
+  int add_servo(uint8_t servolocalID);
+  int add_servo(uint8_t servolocalID, int stretch, int speed);
+  void remove_servo(uint8_t servolocalID);
+
+  // 設定
+  void set_temperature_threshold(int warm, int hot);
+  void set_current_threshold(int warm, int hot);
+  void set_interval(uint32_t normal_us, uint32_t warm_us);
+  void set_derate_limit(int stretch_min, int speed_min);
+
+  // 制御周期ごとに呼ぶ　戻り値に通信したID、通信無しなら -1
+  int update();
+
+  // 状態取得
+  const IcsHealthState *get_state(uint8_t servolocalID);
+
+  // プライベート関数
+private:
+  int classify(IcsHealthState *st);
+  void sync_nominal(uint8_t servolocalID, IcsHealthState *st);
+  bool derate_target(IcsHealthState *st, int *stretch, int *speed);
+  bool apply_derate(uint8_t servolocalID, IcsHealthState *st);
+};
+
+#endif
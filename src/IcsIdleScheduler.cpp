@@ -0,0 +1,140 @@
+#include "IcsIdleScheduler.hpp"
+
+// コンストラクタ
+// planner は IcsCommunication と同じボーレート・タイミングに設定しておくこと
+IcsIdleScheduler::IcsIdleScheduler(IcsCommunication &icsref,
+                                   IcsBusPlanner &plannerref) {
+  ics = &icsref;
+  planner = &plannerref;
+}
+
+// 完了通知の登録
+void IcsIdleScheduler::attach(Callback<void(const IcsIdleJob &, int)> cb) {
+  done = cb;
+}
+
+// 見積もりに足す余裕（usec）
+void IcsIdleScheduler::set_margin(uint32_t margin_us) { marginUs = margin_us; }
+
+// キューに追加
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsIdleScheduler::push(int kind, uint8_t servolocalID, EEPROMdata *edata) {
+  // 引数チェック
+  if ((kind < 0) || (kind >= ICS_JOB_NUM)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((kind == ICS_JOB_EEPROM) && (edata == nullptr)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  // 位置の読み取りは、脱力せず1往復で済む3.6サーボのみ
+  if ((kind == ICS_JOB_POSITION) &&
+      (ics->get_icsversion_cached(servolocalID) != ICS_VERSION_36)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if (queueNum >= QUEUE_MAX) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  IcsIdleJob *job = &queue[(queueHead + queueNum) % QUEUE_MAX];
+  job->kind = kind;
+  job->id = servolocalID;
+  job->edata = edata;
+  queueNum++;
+
+  return RETCODE_OK;
+}
+
+// キュー内のジョブ数
+int IcsIdleScheduler::size() { return queueNum; }
+
+// キューを空にする
+void IcsIdleScheduler::clear() {
+  queueHead = 0;
+  queueNum = 0;
+}
+
+// 実行したジョブ数、時間が足りず次周期に回した回数
+uint32_t IcsIdleScheduler::get_executed() { return executed; }
+
+uint32_t IcsIdleScheduler::get_deferred() { return deferred; }
+
+// 空き時間の実行
+// キューを先頭から1周し、残り時間に収まるジョブを実行する。収まらないジョブは
+// キューの後ろに回して次周期に持ち越す（1つの大きなジョブで詰まらないように）。
+int IcsIdleScheduler::run_idle(uint32_t deadline_us) {
+  int num = 0;
+  int scan = queueNum;
+
+  while ((scan > 0) && (queueNum > 0)) {
+    int32_t remain = (int32_t)(deadline_us - us_ticker_read());
+    if (remain <= 0) {
+      break;
+    }
+    scan--;
+
+    // 実行中に完了通知から push されてもよいよう、先に取り出す
+    IcsIdleJob tmpjob = queue[queueHead];
+    queueHead = (queueHead + 1) % QUEUE_MAX;
+    queueNum--;
+
+    if ((uint32_t)remain < estimate_us(&tmpjob) + marginUs) {
+      // 収まらない　後ろに回す（取り出した直後なので必ず空きがある）
+      queue[(queueHead + queueNum) % QUEUE_MAX] = tmpjob;
+      queueNum++;
+      deferred++;
+      continue;
+    }
+
+    int result = execute(&tmpjob);
+    executed++;
+    num++;
+    if (done) {
+      done(tmpjob, result);
+    }
+  }
+
+  return num;
+}
+
+// ジョブ1つのバス占有時間の見積もり
+uint32_t IcsIdleScheduler::estimate_us(const IcsIdleJob *job) {
+  switch (job->kind) {
+  case ICS_JOB_POSITION:
+    // push で3.6のみに限っている
+    return planner->command_us(ICS_CMD_READPOSITION);
+  case ICS_JOB_EEPROM:
+    return planner->command_us(ICS_CMD_READEEPROM);
+  default:
+    return planner->command_us(ICS_CMD_READPARAM);
+  }
+}
+
+// ジョブ実行
+// 戻り値に読み取り値、またはエラーコード（負の値）が入ります。
+int IcsIdleScheduler::execute(const IcsIdleJob *job) {
+  switch (job->kind) {
+  case ICS_JOB_CURRENT:
+    return ics->get_current(job->id);
+  case ICS_JOB_TEMPERATURE:
+    return ics->get_temperature(job->id);
+  case ICS_JOB_STRETCH:
+    return ics->get_stretch(job->id);
+  case ICS_JOB_SPEED:
+    return ics->get_speed(job->id);
+  case ICS_JOB_POSITION:
+    // push の後にキャッシュが破棄された場合、ここで検出や脱力をさせない
+    if (ics->get_icsversion_cached(job->id) != ICS_VERSION_36) {
+      return RETCODE_ERROR_OPTIONWRONG;
+    }
+    return ics->get_position(job->id);
+  case ICS_JOB_PRESENCE:
+    return (ics->get_stretch(job->id) >= 0) ? 1 : 0;
+  case ICS_JOB_EEPROM:
+    return ics->get_EEPROM(job->id, job->edata);
+  default:
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+}
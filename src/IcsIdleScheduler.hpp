@@ -0,0 +1,85 @@
+#ifndef _ICS_IDLE_SCHEDULER_HPP_
+#define _ICS_IDLE_SCHEDULER_HPP_
+
+#include "IcsBusPlanner.hpp"
+#include "IcsCommunication.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// 制御周期の空き時間に、溜めておいた読み取り（テレメトリ・診断）を実行する
+// 制御処理の最後に run_idle(周期の終了時刻) を呼ぶと、IcsBusPlanner の見積もりで
+// 残り時間に収まる分だけキューから取り出して実行する。収まらないジョブは
+// 次周期に回し、後ろのジョブで収まるものを先に実行する。
+// キューは固定長（ヒープを使わない）。
+// 注意：返信の無いIDはタイムアウトまで待つので、set_timeout を短めにしておくこと。
+// 位置の読み取り（ICS_JOB_POSITION）は、ICS3.6と検出済みのIDのみ受け付ける。
+// 3.5サーボの位置取得は脱力＋即動作で、制御中の目標位置を上書きしてしまうため。
+// バージョン検出（get_icsversion、未検出IDではタイムアウト待ちを含む）は、
+// 起動時など制御周期の外で済ませておくこと。
+
+// ジョブ種別
+static const int ICS_JOB_CURRENT = 0;     // get_current
+static const int ICS_JOB_TEMPERATURE = 1; // get_temperature
+static const int ICS_JOB_STRETCH = 2;     // get_stretch
+static const int ICS_JOB_SPEED = 3;       // get_speed
+static const int ICS_JOB_POSITION = 4;    // get_position（ICS3.6のみ）
+static const int ICS_JOB_PRESENCE = 5;    // 存在確認（返信があれば 1、無ければ 0）
+static const int ICS_JOB_EEPROM = 6;      // get_EEPROM（結果は edata に入る）
+static const int ICS_JOB_NUM = 7;
+
+struct IcsIdleJob
+{
+  uint8_t kind;
+  uint8_t id;
+  EEPROMdata *edata; // ICS_JOB_EEPROM のみ
+};
+
+class IcsIdleScheduler
+{
+  // パブリック変数
+public:
+  static const int QUEUE_MAX = 32;
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+  IcsBusPlanner *planner;
+  Callback<void(const IcsIdleJob &, int)> done;
+
+  IcsIdleJob queue[QUEUE_MAX];
+  int queueHead = 0;
+  int queueNum = 0;
+
+  uint32_t marginUs = 50; // 見積もりに足す余裕
+  uint32_t executed = 0;
+  uint32_t deferred = 0; // 収まらず次周期に回したジョブ数（延べ）
+
+  // パブリック関数
+public:
+  IcsIdleScheduler(IcsCommunication &icsref, IcsBusPlanner &plannerref);
+
+  // 完了通知（ジョブ、結果値またはエラーコード）
+  void attach(Callback<void(const IcsIdleJob &, int)> cb);
+  void set_margin(uint32_t margin_us);
+
+  // キュー操作　戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）
+  int push(int kind, uint8_t servolocalID, EEPROMdata *edata = nullptr);
+  int size();
+  void clear();
+
+  // 空き時間の実行
+  // 引数：　この時刻（us_ticker_read基準）までに終わる分だけ実行する
+  // 戻り値に実行したジョブ数が入ります。
+  int run_idle(uint32_t deadline_us);
+
+  // 統計
+  uint32_t get_executed();
+  uint32_t get_deferred();
+
+  // プライベート関数
+private:
+  uint32_t estimate_us(const IcsIdleJob *job);
+  int execute(const IcsIdleJob *job);
+};
+
+#endif
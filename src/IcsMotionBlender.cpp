@@ -0,0 +1,228 @@
+#include "IcsMotionBlender.hpp"
+
+// コンストラクタ
+IcsMotionBlender::IcsMotionBlender() {
+  for (int id = 0; id < ID_NUM; id++) {
+    limitLow[id] = POS_MIN;
+    limitHigh[id] = POS_MAX;
+  }
+}
+
+bool IcsMotionBlender::check_layer(int lnum) {
+  return (lnum >= 0) && (lnum < LAYER_MAX);
+}
+
+// レイヤーの設定（重み・対象IDはそのまま、フェードは 0 から）
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsMotionBlender::set_layer(int lnum, const int *source, int mode) {
+  // 引数チェック
+  if (!check_layer(lnum) || (source == nullptr) ||
+      ((mode != ICS_BLEND_OVERRIDE) && (mode != ICS_BLEND_ADDITIVE))) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  Layer *l = &layer[lnum];
+  l->source = source;
+  l->mode = mode;
+  l->fade = 0;
+  l->fadeStep = 0;
+  l->active = false;
+  return RETCODE_OK;
+}
+
+int IcsMotionBlender::set_weight(int lnum, int weight) {
+  // 引数チェック
+  if (!check_layer(lnum) || (weight < 0) || (weight > WEIGHT_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  layer[lnum].weight = weight;
+  return RETCODE_OK;
+}
+
+int IcsMotionBlender::set_mask(int lnum, uint32_t idmask) {
+  // 引数チェック
+  if (!check_layer(lnum)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  layer[lnum].mask = idmask;
+  return RETCODE_OK;
+}
+
+// フェードイン　今のフェード位置から始めるので、フェードアウト途中でも飛ばない
+int IcsMotionBlender::fade_in(int lnum, int ticks) {
+  // 引数チェック
+  if (!check_layer(lnum) || (layer[lnum].source == nullptr) || (ticks < 0)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  Layer *l = &layer[lnum];
+  l->active = true;
+  if (ticks == 0) {
+    l->fade = FADE_FULL;
+    l->fadeStep = 0;
+  } else {
+    l->fadeStep = FADE_FULL / ticks;
+    if (l->fadeStep == 0) {
+      l->fadeStep = 1;
+    }
+  }
+  return RETCODE_OK;
+}
+
+int IcsMotionBlender::fade_out(int lnum, int ticks) {
+  // 引数チェック
+  if (!check_layer(lnum) || (ticks < 0)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  Layer *l = &layer[lnum];
+  if (ticks == 0) {
+    l->fade = 0;
+    l->fadeStep = 0;
+    l->active = false;
+  } else {
+    l->fadeStep = -(int32_t)(FADE_FULL / ticks);
+    if (l->fadeStep == 0) {
+      l->fadeStep = -1;
+    }
+  }
+  return RETCODE_OK;
+}
+
+bool IcsMotionBlender::is_active(int lnum) {
+  return check_layer(lnum) && layer[lnum].active;
+}
+
+int IcsMotionBlender::get_effective_weight(int lnum) {
+  if (!check_layer(lnum) || !layer[lnum].active) {
+    return 0;
+  }
+  return (uint32_t)layer[lnum].weight * layer[lnum].fade / FADE_FULL;
+}
+
+// 可動範囲の設定
+int IcsMotionBlender::set_limit(uint8_t servolocalID, int low, int high) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX) || (low > high) ||
+      (low < POS_MIN) || (high > POS_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  limitLow[servolocalID] = low;
+  limitHigh[servolocalID] = high;
+  return RETCODE_OK;
+}
+
+// EEPROM設定から可動範囲を設定（値の無い方は POS_MIN/POS_MAX）
+int IcsMotionBlender::set_limit(uint8_t servolocalID,
+                                const IcsPackedConfig *cfg) {
+  int low = POS_MIN;
+  int high = POS_MAX;
+
+  if (ics_packed_isset(cfg, ICS_FIELD_POSLIMITLOW)) {
+    low = ics_packed_get(cfg, ICS_FIELD_POSLIMITLOW);
+  }
+  if (ics_packed_isset(cfg, ICS_FIELD_POSLIMITHIGH)) {
+    high = ics_packed_get(cfg, ICS_FIELD_POSLIMITHIGH);
+  }
+  return set_limit(servolocalID, low, high);
+}
+
+int IcsMotionBlender::read_limits(IcsCommunication &ics, uint32_t idmask) {
+  int tmpretcode = RETCODE_OK;
+
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if ((idmask & (1UL << id)) == 0) {
+      continue;
+    }
+    IcsPackedConfig cfg;
+    int ret = ics.get_EEPROM(id, &cfg);
+    if (ret == RETCODE_OK) {
+      ret = set_limit(id, &cfg);
+    }
+    if ((ret != RETCODE_OK) && (tmpretcode == RETCODE_OK)) {
+      tmpretcode = ret;
+    }
+  }
+  return tmpretcode;
+}
+
+// 合成
+uint32_t IcsMotionBlender::blend(int *targets) {
+  uint32_t start = us_ticker_read();
+  uint32_t has = 0;
+  uint32_t clampmask = 0;
+
+  for (int lnum = 0; lnum < LAYER_MAX; lnum++) {
+    Layer *l = &layer[lnum];
+    if (!l->active) {
+      continue;
+    }
+
+    // フェードを進める
+    int32_t f = (int32_t)l->fade + l->fadeStep;
+    if (f >= (int32_t)FADE_FULL) {
+      f = FADE_FULL;
+      l->fadeStep = 0;
+    } else if (f <= 0) {
+      f = 0;
+      if (l->fadeStep < 0) {
+        l->fadeStep = 0;
+        l->active = false;
+      }
+    }
+    l->fade = f;
+
+    // 実効重み（このレイヤーの中では一定）
+    int w = (uint32_t)l->weight * l->fade / FADE_FULL;
+    if ((w == 0) || (l->mask == 0)) {
+      continue;
+    }
+
+    const int *src = l->source;
+    uint32_t mask = l->mask;
+    if (l->mode == ICS_BLEND_OVERRIDE) {
+      for (int id = 0; id < ID_NUM; id++) {
+        uint32_t bit = 1UL << id;
+        int v = src[id];
+        if (((mask & bit) == 0) || (v < POS_MIN) || (v > POS_MAX)) {
+          continue;
+        }
+        if (has & bit) {
+          targets[id] += (v - targets[id]) * w / WEIGHT_MAX;
+        } else {
+          targets[id] = v;
+          has |= bit;
+        }
+      }
+    } else {
+      mask &= has;
+      for (int id = 0; id < ID_NUM; id++) {
+        if (mask & (1UL << id)) {
+          targets[id] += src[id] * w / WEIGHT_MAX;
+        }
+      }
+    }
+  }
+
+  // 可動範囲で制限
+  for (int id = 0; id < ID_NUM; id++) {
+    uint32_t bit = 1UL << id;
+    if ((has & bit) == 0) {
+      targets[id] = NO_TARGET;
+    } else if (targets[id] < limitLow[id]) {
+      targets[id] = limitLow[id];
+      clampmask |= bit;
+    } else if (targets[id] > limitHigh[id]) {
+      targets[id] = limitHigh[id];
+      clampmask |= bit;
+    }
+  }
+
+  clamped = clampmask;
+  blendUs = us_ticker_read() - start;
+  return has;
+}
+
+uint32_t IcsMotionBlender::get_clamped() { return clamped; }
+
+uint32_t IcsMotionBlender::get_blend_us() { return blendUs; }
@@ -0,0 +1,97 @@
+#ifndef _ICS_MOTION_BLENDER_HPP_
+#define _ICS_MOTION_BLENDER_HPP_
+
+#include "IcsCommunication.hpp"
+#include "IcsPackedConfig.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// 複数モーションの重ね合わせ（レイヤー合成）
+// 歩行の上に上半身のジェスチャ、さらにその上にバランス補正、のように、
+// 複数のモーション（全サーボの目標位置の配列）を制御周期ごとに合成する。
+// レイヤーは番号の小さい順に重ねる。各レイヤーは
+//  重み（0-256）、対象ID（idmask）、フェードイン/アウト（周期数）
+// を持ち、合成方法は次の2種類。
+//  ICS_BLEND_OVERRIDE: 下のレイヤーの結果から、このレイヤーの位置へ重みの分だけ
+//                      寄せる（下に値が無いIDは、このレイヤーの位置そのもの）
+//  ICS_BLEND_ADDITIVE: このレイヤーの値を位置の差分として、重みを掛けて足す
+//                      （下に値が無いIDには何もしない）
+// 最後にサーボごとの可動範囲（EEPROMの poslimitlow/poslimithigh）で制限する。
+//
+// モーションの配列は参照するだけでコピーしないので、呼び出し側は各周期に
+// 配列の中身を更新してから blend を呼ぶ。OVERRIDE の配列で POS_MIN～POS_MAX の
+// 範囲外の値（-1 等）は「このIDの値は無い」とみなす。
+// blend は、レイヤーごとの実効重みを先に計算し、あとはIDごとの整数演算のみ。
+
+// 合成方法
+static const int ICS_BLEND_OVERRIDE = 0;
+static const int ICS_BLEND_ADDITIVE = 1;
+
+class IcsMotionBlender
+{
+  // パブリック変数
+public:
+  static const int LAYER_MAX = 4;
+  static const int WEIGHT_MAX = 256;
+  static const int NO_TARGET = -1; // どのレイヤーも値を持たないID
+
+  // プライベート変数
+private:
+  static const uint32_t FADE_FULL = 1UL << 16;
+
+  struct Layer
+  {
+    const int *source = nullptr;
+    int mode = ICS_BLEND_OVERRIDE;
+    uint32_t mask = 0xFFFFFFFFUL;
+    int weight = WEIGHT_MAX;
+    uint32_t fade = 0;    // 0～FADE_FULL
+    int32_t fadeStep = 0; // 1周期あたりの変化（負でフェードアウト）
+    bool active = false;
+  };
+  Layer layer[LAYER_MAX];
+
+  int16_t limitLow[ID_NUM];
+  int16_t limitHigh[ID_NUM];
+
+  uint32_t clamped = 0; // 直前の blend で可動範囲に制限したID
+  uint32_t blendUs = 0; // 直前の blend の計算時間
+
+  // パブリック関数
+public:
+  IcsMotionBlender();
+
+  // レイヤーの設定
+  //  source: 目標位置（ID添字）、ADDITIVE は差分
+  int set_layer(int lnum, const int *source, int mode = ICS_BLEND_OVERRIDE);
+  int set_weight(int lnum, int weight);
+  int set_mask(int lnum, uint32_t idmask);
+  // フェード　ticks 周期かけて重みを 0→設定値（in）、設定値→0（out）にする
+  //  ticks に 0 で即時。フェードアウトが終わるとレイヤーは止まる。
+  int fade_in(int lnum, int ticks = 0);
+  int fade_out(int lnum, int ticks = 0);
+  bool is_active(int lnum);
+  // 今の実効重み（重み × フェード、0-256）
+  int get_effective_weight(int lnum);
+
+  // 可動範囲
+  int set_limit(uint8_t servolocalID, int low, int high);
+  int set_limit(uint8_t servolocalID, const IcsPackedConfig *cfg);
+  // idmask の各IDのEEPROMを読み取って可動範囲を設定する
+  // 戻り値にRETCODE_OK（1の値）、または最初の失敗のエラーコード（負の値）
+  int read_limits(IcsCommunication &ics, uint32_t idmask);
+
+  // 合成（制御周期ごとに1回呼ぶ　フェードもここで進む）
+  //  targets: 結果（ID添字）　値の無いIDは NO_TARGET
+  //  戻り値に値の出たIDのマスク（1 << ID）が入ります。
+  uint32_t blend(int *targets);
+
+  uint32_t get_clamped(); // 直前の blend で可動範囲に制限したID
+  uint32_t get_blend_us();
+
+  // プライベート関数
+private:
+  bool check_layer(int lnum);
+};
+
+#endif
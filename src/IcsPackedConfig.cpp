@@ -0,0 +1,362 @@
+#include "IcsPackedConfig.hpp"
+#include "IcsCodec.hpp"
+
+// 項目ごとの正当な範囲（ics_check_EEPROMdata と同じ）
+// commspeed は 115200/625000/1250000 のみなので別扱い
+static const int16_t FIELD_MIN[ICS_FIELD_NUM] = {
+    1, 1, 0, 0, 1, 1, 0, 0, 0, 0, 0, 8000, POS_MIN, 0, 1, 1, 1, -127, 0,
+    1, 1, 1};
+static const int16_t FIELD_MAX[ICS_FIELD_NUM] = {
+    127, 127, 10, 16, 255, 255, 1, 1, 1, 1, 1, POS_MAX, 7000, 0, 127, 63, 5,
+    127, ID_MAX, 127, 127, 127};
+
+// EEPROMdata のメンバ（項目番号順）
+static int EEPROMdata::*const FIELD_MEMBER[ICS_FIELD_NUM] = {
+    &EEPROMdata::stretch,          &EEPROMdata::speed,
+    &EEPROMdata::punch,            &EEPROMdata::deadband,
+    &EEPROMdata::dumping,          &EEPROMdata::safetimer,
+    &EEPROMdata::flag_slave,       &EEPROMdata::flag_rotation,
+    &EEPROMdata::flag_pwminh,      &EEPROMdata::flag_free,
+    &EEPROMdata::flag_reverse,     &EEPROMdata::poslimithigh,
+    &EEPROMdata::poslimitlow,      &EEPROMdata::commspeed,
+    &EEPROMdata::temperaturelimit, &EEPROMdata::currentlimit,
+    &EEPROMdata::response,         &EEPROMdata::offset,
+    &EEPROMdata::ID,               &EEPROMdata::charstretch1,
+    &EEPROMdata::charstretch2,     &EEPROMdata::charstretch3};
+
+// EEPROM生バイト内で、上位下位4bitずつ2byteに収納されている項目
+struct ByteField
+{
+  uint8_t field;
+  uint8_t pos;   // 上位4bitの位置
+  uint8_t scale; // 2倍値で収納されている項目は 2
+};
+
+static const ByteField BYTE_FIELDS[] = {
+    {ICS_FIELD_STRETCH, 4, 2},           {ICS_FIELD_SPEED, 6, 1},
+    {ICS_FIELD_PUNCH, 8, 1},             {ICS_FIELD_DEADBAND, 10, 1},
+    {ICS_FIELD_DUMPING, 12, 1},          {ICS_FIELD_SAFETIMER, 14, 1},
+    {ICS_FIELD_TEMPERATURELIMIT, 30, 1}, {ICS_FIELD_CURRENTLIMIT, 32, 1},
+    {ICS_FIELD_RESPONSE, 52, 1},         {ICS_FIELD_ID, 58, 1},
+    {ICS_FIELD_CHARSTRETCH1, 60, 2},     {ICS_FIELD_CHARSTRETCH2, 62, 2},
+    {ICS_FIELD_CHARSTRETCH3, 64, 2}};
+
+static const int BYTE_FIELD_NUM = sizeof(BYTE_FIELDS) / sizeof(BYTE_FIELDS[0]);
+
+// 通信速度　commspeed ビットフィールドの値 → bps
+static const int32_t COMMSPEED_BPS[3] = {1250000, 625000, 115200};
+// 通信速度　EEPROM内の値（0x00, 0x01, 0x0A）
+static const uint8_t COMMSPEED_EEPROM[3] = {0x00, 0x01, 0x0A};
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// 項目の読み書き
+
+bool ics_packed_isset(const IcsPackedConfig *cfg, int field) {
+  if ((field < 0) || (field >= ICS_FIELD_NUM)) {
+    return false;
+  }
+  return (cfg->mask >> field) & 1;
+}
+
+void ics_packed_clear(IcsPackedConfig *cfg, int field) {
+  if ((field < 0) || (field >= ICS_FIELD_NUM)) {
+    return;
+  }
+  cfg->mask &= ~(1UL << field);
+}
+
+// 項目の値取得　値が無ければ EEPROM_NOTCHANGE
+int ics_packed_get(const IcsPackedConfig *cfg, int field) {
+  if (!ics_packed_isset(cfg, field)) {
+    return EEPROM_NOTCHANGE;
+  }
+
+  switch (field) {
+  case ICS_FIELD_STRETCH:
+    return cfg->stretch;
+  case ICS_FIELD_SPEED:
+    return cfg->speed;
+  case ICS_FIELD_PUNCH:
+    return cfg->punch;
+  case ICS_FIELD_DEADBAND:
+    return cfg->deadband;
+  case ICS_FIELD_DUMPING:
+    return cfg->dumping;
+  case ICS_FIELD_SAFETIMER:
+    return cfg->safetimer;
+  case ICS_FIELD_FLAG_SLAVE:
+    return cfg->flag_slave;
+  case ICS_FIELD_FLAG_ROTATION:
+    return cfg->flag_rotation;
+  case ICS_FIELD_FLAG_PWMINH:
+    return cfg->flag_pwminh;
+  case ICS_FIELD_FLAG_FREE:
+    return cfg->flag_free;
+  case ICS_FIELD_FLAG_REVERSE:
+    return cfg->flag_reverse;
+  case ICS_FIELD_POSLIMITHIGH:
+    return cfg->poslimithigh;
+  case ICS_FIELD_POSLIMITLOW:
+    return cfg->poslimitlow;
+  case ICS_FIELD_COMMSPEED:
+    return COMMSPEED_BPS[cfg->commspeed];
+  case ICS_FIELD_TEMPERATURELIMIT:
+    return cfg->temperaturelimit;
+  case ICS_FIELD_CURRENTLIMIT:
+    return cfg->currentlimit;
+  case ICS_FIELD_RESPONSE:
+    return cfg->response;
+  case ICS_FIELD_OFFSET:
+    return cfg->offset;
+  case ICS_FIELD_ID:
+    return cfg->ID;
+  case ICS_FIELD_CHARSTRETCH1:
+    return cfg->charstretch1;
+  case ICS_FIELD_CHARSTRETCH2:
+    return cfg->charstretch2;
+  case ICS_FIELD_CHARSTRETCH3:
+    return cfg->charstretch3;
+  default:
+    return EEPROM_NOTCHANGE;
+  }
+}
+
+// 項目の値設定　EEPROM_NOTCHANGE を渡すと値無しにする
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int ics_packed_set(IcsPackedConfig *cfg, int field, int val) {
+  if ((field < 0) || (field >= ICS_FIELD_NUM)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if (val == EEPROM_NOTCHANGE) {
+    ics_packed_clear(cfg, field);
+    return RETCODE_OK;
+  }
+
+  if (field == ICS_FIELD_COMMSPEED) {
+    int a;
+    for (a = 0; a < 3; a++) {
+      if (COMMSPEED_BPS[a] == val) {
+        break;
+      }
+    }
+    if (a == 3) {
+      return RETCODE_ERROR_EEPROMDATAWRONG;
+    }
+    val = a;
+  } else if ((val < FIELD_MIN[field]) || (val > FIELD_MAX[field])) {
+    return RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  switch (field) {
+  case ICS_FIELD_STRETCH:
+    cfg->stretch = val;
+    break;
+  case ICS_FIELD_SPEED:
+    cfg->speed = val;
+    break;
+  case ICS_FIELD_PUNCH:
+    cfg->punch = val;
+    break;
+  case ICS_FIELD_DEADBAND:
+    cfg->deadband = val;
+    break;
+  case ICS_FIELD_DUMPING:
+    cfg->dumping = val;
+    break;
+  case ICS_FIELD_SAFETIMER:
+    cfg->safetimer = val;
+    break;
+  case ICS_FIELD_FLAG_SLAVE:
+    cfg->flag_slave = val;
+    break;
+  case ICS_FIELD_FLAG_ROTATION:
+    cfg->flag_rotation = val;
+    break;
+  case ICS_FIELD_FLAG_PWMINH:
+    cfg->flag_pwminh = val;
+    break;
+  case ICS_FIELD_FLAG_FREE:
+    cfg->flag_free = val;
+    break;
+  case ICS_FIELD_FLAG_REVERSE:
+    cfg->flag_reverse = val;
+    break;
+  case ICS_FIELD_POSLIMITHIGH:
+    cfg->poslimithigh = val;
+    break;
+  case ICS_FIELD_POSLIMITLOW:
+    cfg->poslimitlow = val;
+    break;
+  case ICS_FIELD_COMMSPEED:
+    cfg->commspeed = val;
+    break;
+  case ICS_FIELD_TEMPERATURELIMIT:
+    cfg->temperaturelimit = val;
+    break;
+  case ICS_FIELD_CURRENTLIMIT:
+    cfg->currentlimit = val;
+    break;
+  case ICS_FIELD_RESPONSE:
+    cfg->response = val;
+    break;
+  case ICS_FIELD_OFFSET:
+    cfg->offset = val;
+    break;
+  case ICS_FIELD_ID:
+    cfg->ID = val;
+    break;
+  case ICS_FIELD_CHARSTRETCH1:
+    cfg->charstretch1 = val;
+    break;
+  case ICS_FIELD_CHARSTRETCH2:
+    cfg->charstretch2 = val;
+    break;
+  case ICS_FIELD_CHARSTRETCH3:
+    cfg->charstretch3 = val;
+    break;
+  }
+  cfg->mask |= 1UL << field;
+
+  return RETCODE_OK;
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// EEPROMdata との相互変換
+
+// EEPROMdata → 省メモリ版　EEPROM_NOTCHANGE の項目は値無しになる
+// 戻り値にRETCODE_OK（1の値）、または範囲外の項目があればエラーコード（負の値）
+int ics_packed_from_EEPROMdata(const EEPROMdata *edata, IcsPackedConfig *cfg) {
+  int tmpretcode = RETCODE_OK;
+
+  cfg->mask = 0;
+  for (int a = 0; a < ICS_FIELD_NUM; a++) {
+    if (ics_packed_set(cfg, a, edata->*FIELD_MEMBER[a]) != RETCODE_OK) {
+      tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+    }
+  }
+  return tmpretcode;
+}
+
+// 省メモリ版 → EEPROMdata　値無しの項目は EEPROM_NOTCHANGE になる
+void ics_packed_to_EEPROMdata(const IcsPackedConfig *cfg, EEPROMdata *edata) {
+  for (int a = 0; a < ICS_FIELD_NUM; a++) {
+    edata->*FIELD_MEMBER[a] = ics_packed_get(cfg, a);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////
+// EEPROM生バイトとの直接変換（ics_decode_EEPROM / ics_encode_EEPROM と同じ配置）
+
+// EEPROM生バイト → 省メモリ版
+// 戻り値にRETCODE_OK（1の値）、または範囲外の項目があればエラーコード（負の値）
+int ics_decode_EEPROM_packed(const uint8_t *rxbuf, IcsPackedConfig *cfg) {
+  int tmpretcode = RETCODE_OK;
+  int val;
+
+  cfg->mask = 0;
+
+  for (int a = 0; a < BYTE_FIELD_NUM; a++) {
+    const ByteField *f = &BYTE_FIELDS[a];
+    val = ics_combine_2byte(rxbuf[f->pos], rxbuf[f->pos + 1]) / f->scale;
+    if (ics_packed_set(cfg, f->field, val) != RETCODE_OK) {
+      tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+    }
+  }
+
+  ics_packed_set(cfg, ICS_FIELD_FLAG_SLAVE, (rxbuf[16] >> 3) & 0b00000001);
+  ics_packed_set(cfg, ICS_FIELD_FLAG_ROTATION, (rxbuf[16]) & 0b00000001);
+  ics_packed_set(cfg, ICS_FIELD_FLAG_PWMINH, (rxbuf[17] >> 3) & 0b00000001);
+  ics_packed_set(cfg, ICS_FIELD_FLAG_FREE, (rxbuf[17] >> 1) & 0b00000001);
+  ics_packed_set(cfg, ICS_FIELD_FLAG_REVERSE, (rxbuf[17]) & 0b00000001);
+
+  val = (ics_combine_2byte(rxbuf[18], rxbuf[19]) << 8) |
+        ics_combine_2byte(rxbuf[20], rxbuf[21]);
+  if (ics_packed_set(cfg, ICS_FIELD_POSLIMITHIGH, val) != RETCODE_OK) {
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+  val = (ics_combine_2byte(rxbuf[22], rxbuf[23]) << 8) |
+        ics_combine_2byte(rxbuf[24], rxbuf[25]);
+  if (ics_packed_set(cfg, ICS_FIELD_POSLIMITLOW, val) != RETCODE_OK) {
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  // 不明な通信速度は値無しのまま（EEPROMdata の EEPROM_NOTCHANGE と同じ）
+  val = ics_combine_2byte(rxbuf[28], rxbuf[29]);
+  for (int a = 0; a < 3; a++) {
+    if (COMMSPEED_EEPROM[a] == val) {
+      ics_packed_set(cfg, ICS_FIELD_COMMSPEED, COMMSPEED_BPS[a]);
+    }
+  }
+
+  // ICSマネージャ挙動では、正負反対に収納されているのでそれに合わせる
+  uint8_t tmpoffset = ics_combine_2byte(rxbuf[54], rxbuf[55]);
+  if ((tmpoffset >> 7) == 0b00000001) { // 負ビット
+    val = ((~(tmpoffset)&0b01111111) + 1);
+  } else { // 正ビット
+    val = 0 - tmpoffset;
+  }
+  if (ics_packed_set(cfg, ICS_FIELD_OFFSET, val) != RETCODE_OK) {
+    tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+  }
+
+  return tmpretcode;
+}
+
+// 省メモリ版 → EEPROM生バイト（mask の立っている項目のみ上書き）
+// buf には事前に読み取った元のEEPROM生バイトを入れておくこと。
+void ics_encode_EEPROM_packed(uint8_t *buf, const IcsPackedConfig *cfg) {
+  int val;
+
+  for (int a = 0; a < BYTE_FIELD_NUM; a++) {
+    const ByteField *f = &BYTE_FIELDS[a];
+    if (!ics_packed_isset(cfg, f->field)) {
+      continue;
+    }
+    uint8_t tmp = ics_packed_get(cfg, f->field) * f->scale;
+    buf[f->pos] = tmp >> 4;
+    buf[f->pos + 1] = tmp & 0b00001111;
+  }
+
+  if (ics_packed_isset(cfg, ICS_FIELD_FLAG_SLAVE)) {
+    buf[16] = (buf[16] & 0b11110111) | (cfg->flag_slave << 3);
+  }
+  if (ics_packed_isset(cfg, ICS_FIELD_FLAG_ROTATION)) {
+    buf[16] = (buf[16] & 0b11111110) | cfg->flag_rotation;
+  }
+  if (ics_packed_isset(cfg, ICS_FIELD_FLAG_PWMINH)) {
+    buf[17] = (buf[17] & 0b11110111) | (cfg->flag_pwminh << 3);
+  }
+  // freeフラグは参照のみ（ics_encode_EEPROM と同じく書き込まない）
+  if (ics_packed_isset(cfg, ICS_FIELD_FLAG_REVERSE)) {
+    buf[17] = (buf[17] & 0b11111110) | cfg->flag_reverse;
+  }
+
+  if (ics_packed_isset(cfg, ICS_FIELD_POSLIMITHIGH)) {
+    val = cfg->poslimithigh;
+    buf[18] = (val >> 12) & 0b00001111;
+    buf[19] = (val >> 8) & 0b00001111;
+    buf[20] = (val >> 4) & 0b00001111;
+    buf[21] = (val)&0b00001111;
+  }
+  if (ics_packed_isset(cfg, ICS_FIELD_POSLIMITLOW)) {
+    val = cfg->poslimitlow;
+    buf[22] = (val >> 12) & 0b00001111;
+    buf[23] = (val >> 8) & 0b00001111;
+    buf[24] = (val >> 4) & 0b00001111;
+    buf[25] = (val)&0b00001111;
+  }
+
+  if (ics_packed_isset(cfg, ICS_FIELD_COMMSPEED)) {
+    buf[28] = COMMSPEED_EEPROM[cfg->commspeed] >> 4;
+    buf[29] = COMMSPEED_EEPROM[cfg->commspeed] & 0b00001111;
+  }
+
+  if (ics_packed_isset(cfg, ICS_FIELD_OFFSET)) {
+    uint8_t tmpoffset = ~(cfg->offset) + 1;
+    buf[54] = tmpoffset >> 4;
+    buf[55] = tmpoffset & 0b00001111;
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef _ICS_PACKED_CONFIG_HPP_
+#define _ICS_PACKED_CONFIG_HPP_
+
+#include "IcsDefine.hpp"
+#include "stdint.h"
+
+// サーボ設定（EEPROM内容）の省メモリ版
+// EEPROMdata は int 22個 (88byte) だが、こちらはビットフィールドで 24byte。
+// 32サーボ分の設定をRAMの少ないマイコン（STM32F102 等）に置くためのもの。
+// 「変更しない（EEPROM_NOTCHANGE）」は値ではなく mask のビットで表す。
+// 値の読み書きは ics_packed_get / ics_packed_set を使う（範囲チェック付き）。
+// mbedに依存しない。
+
+// 項目番号（EEPROMdata のメンバ順）
+enum IcsConfigField
+{
+  ICS_FIELD_STRETCH = 0,
+  ICS_FIELD_SPEED,
+  ICS_FIELD_PUNCH,
+  ICS_FIELD_DEADBAND,
+  ICS_FIELD_DUMPING,
+  ICS_FIELD_SAFETIMER,
+  ICS_FIELD_FLAG_SLAVE,
+  ICS_FIELD_FLAG_ROTATION,
+  ICS_FIELD_FLAG_PWMINH,
+  ICS_FIELD_FLAG_FREE,
+  ICS_FIELD_FLAG_REVERSE,
+  ICS_FIELD_POSLIMITHIGH,
+  ICS_FIELD_POSLIMITLOW,
+  ICS_FIELD_COMMSPEED,
+  ICS_FIELD_TEMPERATURELIMIT,
+  ICS_FIELD_CURRENTLIMIT,
+  ICS_FIELD_RESPONSE,
+  ICS_FIELD_OFFSET,
+  ICS_FIELD_ID,
+  ICS_FIELD_CHARSTRETCH1,
+  ICS_FIELD_CHARSTRETCH2,
+  ICS_FIELD_CHARSTRETCH3,
+  ICS_FIELD_NUM
+};
+
+struct IcsPackedConfig
+{
+  uint32_t mask = 0; // 値の入っている項目（1 << IcsConfigField）
+
+  uint32_t stretch : 7;
+  uint32_t speed : 7;
+  uint32_t punch : 4;
+  uint32_t deadband : 5;
+  uint32_t flag_slave : 1;
+  uint32_t flag_rotation : 1;
+  uint32_t flag_pwminh : 1;
+  uint32_t flag_free : 1;
+  uint32_t flag_reverse : 1;
+
+  uint32_t poslimithigh : 14;
+  uint32_t poslimitlow : 14;
+  uint32_t commspeed : 2; // 0:1250000 1:625000 2:115200
+
+  uint32_t dumping : 8;
+  uint32_t safetimer : 8;
+  uint32_t temperaturelimit : 7;
+  uint32_t currentlimit : 6;
+
+  uint32_t response : 3;
+  uint32_t ID : 5;
+  uint32_t charstretch1 : 7;
+  uint32_t charstretch2 : 7;
+  uint32_t charstretch3 : 7;
+
+  int8_t offset;
+
+  IcsPackedConfig()
+      : stretch(0), speed(0), punch(0), deadband(0), flag_slave(0),
+        flag_rotation(0), flag_pwminh(0), flag_free(0), flag_reverse(0),
+        poslimithigh(0), poslimitlow(0), commspeed(0), dumping(0),
+        safetimer(0), temperaturelimit(0), currentlimit(0), response(0),
+        ID(0), charstretch1(0), charstretch2(0), charstretch3(0), offset(0) {}
+};
+
+// 項目の読み書き
+// get: 値、または値が無ければ EEPROM_NOTCHANGE
+// set: 戻り値にRETCODE_OK（1の値）、または範囲外なら RETCODE_ERROR_EEPROMDATAWRONG
+int ics_packed_get(const IcsPackedConfig *cfg, int field);
+int ics_packed_set(IcsPackedConfig *cfg, int field, int val);
+void ics_packed_clear(IcsPackedConfig *cfg, int field);
+bool ics_packed_isset(const IcsPackedConfig *cfg, int field);
+
+// EEPROMdata との相互変換（互換用）
+int ics_packed_from_EEPROMdata(const EEPROMdata *edata, IcsPackedConfig *cfg);
+void ics_packed_to_EEPROMdata(const IcsPackedConfig *cfg, EEPROMdata *edata);
+
+// EEPROM生バイト(66byte)との直接変換
+// decode: 全項目を読み込む（範囲外の値があればエラー）
+// encode: mask の立っている項目のみ buf に反映する（flag_free は書き込まない）
+int ics_decode_EEPROM_packed(const uint8_t *rxbuf, IcsPackedConfig *cfg);
+void ics_encode_EEPROM_packed(uint8_t *buf, const IcsPackedConfig *cfg);
+
+#endif
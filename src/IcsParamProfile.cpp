@@ -0,0 +1,222 @@
+#include "IcsParamProfile.hpp"
+#include "string.h"
+
+// パラメータごとの上限（下限はいずれも 1）
+static const int PARAM_MAX[ICS_PARAM_NUM] = {127, 127, 63, 127};
+
+// コンストラクタ
+IcsParamProfile::IcsParamProfile(IcsCommunication &icsref) {
+  ics = &icsref;
+  memset(name, 0, sizeof(name));
+  memset(value, 0, sizeof(value));
+}
+
+// プロファイル登録
+// 戻り値にプロファイル番号、またはエラーコード（負の値）が入ります。
+int IcsParamProfile::add_profile(const char *profname) {
+  // 引数チェック
+  if ((profname == nullptr) || (profname[0] == '\0') ||
+      (strlen(profname) >= NAME_MAX) || (find_profile(profname) >= 0)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  for (int p = 0; p < PROFILE_MAX; p++) {
+    if (name[p][0] == '\0') {
+      strcpy(name[p], profname);
+      memset(value[p], 0, sizeof(value[p]));
+      return p;
+    }
+  }
+  return RETCODE_ERROR_OPTIONWRONG;
+}
+
+// 名前からプロファイル番号を探す　無ければ -1
+int IcsParamProfile::find_profile(const char *profname) {
+  for (int p = 0; p < PROFILE_MAX; p++) {
+    if ((name[p][0] != '\0') && (strcmp(name[p], profname) == 0)) {
+      return p;
+    }
+  }
+  return -1;
+}
+
+// 値の設定
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsParamProfile::set_value(int prof, uint8_t servolocalID, int param,
+                               int val) {
+  // 引数チェック
+  if ((prof < 0) || (prof >= PROFILE_MAX) || (name[prof][0] == '\0')) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  if ((param < 0) || (param >= ICS_PARAM_NUM) || (val < 0) ||
+      (val > PARAM_MAX[param])) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  value[prof][servolocalID][param] = val;
+  return RETCODE_OK;
+}
+
+// 1サーボ分の値をまとめて設定
+int IcsParamProfile::set_servo(int prof, uint8_t servolocalID, int stretch,
+                               int speed, int currentlimit,
+                               int temperaturelimit) {
+  int vals[ICS_PARAM_NUM] = {stretch, speed, currentlimit, temperaturelimit};
+
+  for (int a = 0; a < ICS_PARAM_NUM; a++) {
+    int tmpretcode = set_value(prof, servolocalID, a, vals[a]);
+    if (tmpretcode != RETCODE_OK) {
+      return tmpretcode;
+    }
+  }
+  return RETCODE_OK;
+}
+
+// サーボに書き込み済みの値を読み取る
+// 読み取った値は IcsCommunication が書き込み済みの値として覚える。
+// 電流制限・温度制限は読み取りコマンドが現在値を返すので、不明のままにする。
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsParamProfile::load_current(uint8_t servolocalID) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  int stretch = ics->get_stretch(servolocalID);
+  if (stretch < 0) {
+    return stretch;
+  }
+  int speed = ics->get_speed(servolocalID);
+  if (speed < 0) {
+    return speed;
+  }
+  return RETCODE_OK;
+}
+
+void IcsParamProfile::forget_current() { ics->forget_param_written(); }
+
+// 書き込み済みの値（0 は不明）
+// ICS_PARAM_* の順はサブコマンド（1 stretch ～ 4 温度制限）と同じ
+int IcsParamProfile::get_written(uint8_t servolocalID, int param) {
+  return ics->get_param_written(servolocalID, param + 1);
+}
+
+// 書き込みリストの作成　書き込み済みの値と同じものは省く（force 指定なら省かない）
+// 戻り値にリストの件数が入ります。
+int IcsParamProfile::build_list(int prof, int *skipped, bool force) {
+  int num = 0;
+  *skipped = 0;
+
+  // パラメータ種別ごとに全IDを並べる（stretch が全サーボ揃ってから speed）
+  for (int param = 0; param < ICS_PARAM_NUM; param++) {
+    for (int id = 0; id < ID_NUM; id++) {
+      uint8_t val = value[prof][id][param];
+      if (val == 0) {
+        continue;
+      }
+      int old = get_written(id, param);
+      if (!force && (old == val)) {
+        (*skipped)++;
+        continue;
+      }
+      Entry *e = &list[num++];
+      e->id = id;
+      e->param = param;
+      e->val = val;
+      e->old = old;
+    }
+  }
+  return num;
+}
+
+// 1フレーム書き込み
+int IcsParamProfile::write_one(uint8_t servolocalID, int param, int val) {
+  switch (param) {
+  case ICS_PARAM_STRETCH:
+    return ics->set_stretch(servolocalID, val);
+  case ICS_PARAM_SPEED:
+    return ics->set_speed(servolocalID, val);
+  case ICS_PARAM_CURRENTLIMIT:
+    return ics->set_currentlimit(servolocalID, val);
+  case ICS_PARAM_TEMPERATURELIMIT:
+    return ics->set_temperaturelimit(servolocalID, val);
+  default:
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+}
+
+// プロファイル適用
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+// 失敗があった場合は最初の失敗のエラーコードを返す。
+// 書き込み済みの値は write_one（IcsCommunication::write_Param）の中で更新される。
+int IcsParamProfile::apply(int prof, bool rollback, IcsProfileResult *result,
+                           bool force) {
+  IcsProfileResult res;
+
+  // 引数チェック
+  if ((prof < 0) || (prof >= PROFILE_MAX) || (name[prof][0] == '\0')) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  int num = build_list(prof, &res.skipped, force);
+  int tmpretcode = RETCODE_OK;
+
+  // 連続送信　ここでは計算を挟まない
+  uint32_t start = us_ticker_read();
+  int a;
+  for (a = 0; a < num; a++) {
+    Entry *e = &list[a];
+    int ret = write_one(e->id, e->param, e->val);
+    if (ret == RETCODE_OK) {
+      res.written++;
+    } else {
+      res.failed++;
+      res.failMask |= 1UL << e->id;
+      if (tmpretcode == RETCODE_OK) {
+        tmpretcode = ret;
+      }
+      if (rollback) {
+        a++;
+        break;
+      }
+    }
+  }
+
+  // ロールバック　この適用で書けた分を、値が分かっていれば元に戻す
+  if (rollback && (res.failed > 0)) {
+    for (int b = a - 1; b >= 0; b--) {
+      Entry *e = &list[b];
+      if (get_written(e->id, e->param) != e->val) {
+        continue;
+      }
+      if (e->old == 0) {
+        res.unrestored++;
+        continue;
+      }
+      if (write_one(e->id, e->param, e->old) == RETCODE_OK) {
+        res.rolledBack++;
+      } else {
+        res.failMask |= 1UL << e->id;
+      }
+    }
+  }
+  res.elapsedUs = us_ticker_read() - start;
+
+  if (result != nullptr) {
+    *result = res;
+  }
+  return tmpretcode;
+}
+
+// 適用に掛かる時間の予測（usec）
+uint32_t IcsParamProfile::estimate_us(int prof, IcsBusPlanner *planner) {
+  if ((prof < 0) || (prof >= PROFILE_MAX) || (name[prof][0] == '\0')) {
+    return 0;
+  }
+  int skipped;
+  int num = build_list(prof, &skipped);
+  return planner->command_us(ICS_CMD_WRITEPARAM) * num;
+}
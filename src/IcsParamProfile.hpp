@@ -0,0 +1,96 @@
+#ifndef _ICS_PARAM_PROFILE_HPP_
+#define _ICS_PARAM_PROFILE_HPP_
+
+#include "IcsBusPlanner.hpp"
+#include "IcsCommunication.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// パラメータ（stretch, speed, 電流制限, 温度制限）のプロファイル切り替え
+// 「柔らかい」「硬い」などの設定を名前付きで事前に登録しておき、apply で一括適用する。
+// 適用時は、サーボに書き込み済みの値と違うものだけを書き込みリストにしてから、
+// 計算を挟まずに連続で送信する（サーボごとに set_stretch 等を呼ぶより短い）。
+// 書き込み済みの値は IcsCommunication が持つもの（get_param_written）を使うので、
+// 他のモジュールが同じ IcsCommunication から書き込んだ分も反映される。
+// サーボの電源を入れ直したときや、別の IcsCommunication・他の機器から
+// 書き込んだときは、forget_current を呼ぶか force 指定で適用すること。
+// 失敗したサーボは報告し、ロールバック指定なら書き込み済みの分を元の値に戻す。
+// （EEPROMではなくパラメータ書き込みなので、電源を切ると元に戻る）
+
+// パラメータ種別
+static const int ICS_PARAM_STRETCH = 0;
+static const int ICS_PARAM_SPEED = 1;
+static const int ICS_PARAM_CURRENTLIMIT = 2;
+static const int ICS_PARAM_TEMPERATURELIMIT = 3;
+static const int ICS_PARAM_NUM = 4;
+
+// 適用結果
+struct IcsProfileResult
+{
+  int written = 0;       // 書き込みに成功したフレーム数
+  int skipped = 0;       // 書き込み済みの値と同じで省略した数
+  int failed = 0;        // 書き込みに失敗したフレーム数
+  int rolledBack = 0;    // 元に戻したフレーム数
+  int unrestored = 0;    // 元の値が不明で戻せなかったフレーム数
+  uint32_t failMask = 0; // 失敗したID（1 << ID）
+  uint32_t elapsedUs = 0;
+};
+
+class IcsParamProfile
+{
+  // パブリック変数
+public:
+  static const int PROFILE_MAX = 4;
+  static const int NAME_MAX = 12; // 終端含む
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+
+  // 0 は「このプロファイルでは変更しない」（各パラメータとも 1 以上が正当な値）
+  char name[PROFILE_MAX][NAME_MAX];
+  uint8_t value[PROFILE_MAX][ID_NUM][ICS_PARAM_NUM];
+
+  // 書き込みリスト
+  struct Entry
+  {
+    uint8_t id;
+    uint8_t param;
+    uint8_t val;
+    uint8_t old;
+  };
+  Entry list[ID_NUM * ICS_PARAM_NUM];
+
+  // パブリック関数
+public:
+  IcsParamProfile(IcsCommunication &icsref);
+
+  // プロファイル登録　戻り値にプロファイル番号、またはエラーコード（負の値）
+  int add_profile(const char *profname);
+  int find_profile(const char *profname);
+  // 値の設定　val に 0 でこのプロファイルでは変更しない
+  int set_value(int prof, uint8_t servolocalID, int param, int val);
+  int set_servo(int prof, uint8_t servolocalID, int stretch, int speed,
+                int currentlimit = 0, int temperaturelimit = 0);
+
+  // サーボに書き込み済みの値の扱い（IcsCommunication の記録を操作する）
+  int load_current(uint8_t servolocalID); // stretch/speed をサーボから読み取る
+  void forget_current();                  // 不明にする（全て書き込み直す）
+
+  // 適用
+  //  rollback: 失敗があれば、この適用で書き込んだ分を元の値に戻す
+  //  force: 書き込み済みの値と同じでも省略せずに全て書き込む
+  //  戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+  int apply(int prof, bool rollback = false, IcsProfileResult *result = nullptr,
+            bool force = false);
+  // 適用に掛かる時間の予測（usec）　書き込み済みの値と同じものは数えない
+  uint32_t estimate_us(int prof, IcsBusPlanner *planner);
+
+  // プライベート関数
+private:
+  int build_list(int prof, int *skipped, bool force = false);
+  int get_written(uint8_t servolocalID, int param);
+  int write_one(uint8_t servolocalID, int param, int val);
+};
+
+#endif
@@ -0,0 +1,250 @@
+#include "IcsPoseSender.hpp"
+
+// コンストラクタ
+IcsPoseSender::IcsPoseSender(IcsCommunication &icsref) {
+  ics = &icsref;
+  for (int a = 0; a < ID_NUM; a++) {
+    mirror[a] = NO_MIRROR;
+    forget_sent(a);
+  }
+}
+
+// 送信対象に追加　prio が大きいほどタイミングが重要な関節
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsPoseSender::add_servo(uint8_t servolocalID, uint8_t prio) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  enabled[servolocalID] = true;
+  priority[servolocalID] = prio;
+  forget_sent(servolocalID);
+  orderDirty = true;
+  return RETCODE_OK;
+}
+
+// 送信対象から外す
+void IcsPoseSender::remove_servo(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return;
+  }
+  enabled[servolocalID] = false;
+  forget_sent(servolocalID);
+  orderDirty = true;
+}
+
+// 優先度変更
+int IcsPoseSender::set_priority(uint8_t servolocalID, uint8_t prio) {
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  priority[servolocalID] = prio;
+  orderDirty = true;
+  return RETCODE_OK;
+}
+
+// 左右対の関節を登録　送信順で隣り合わせにする
+int IcsPoseSender::set_mirror(uint8_t servolocalID_a, uint8_t servolocalID_b) {
+  // 引数チェック
+  if ((servolocalID_a > ID_MAX) || (servolocalID_b > ID_MAX) ||
+      (servolocalID_a == servolocalID_b)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  // 以前の相手の対を外してから組み直す
+  clear_mirror(servolocalID_a);
+  clear_mirror(servolocalID_b);
+  mirror[servolocalID_a] = servolocalID_b;
+  mirror[servolocalID_b] = servolocalID_a;
+  orderDirty = true;
+  return RETCODE_OK;
+}
+
+// 左右対の登録を外す（相手側も外す）
+void IcsPoseSender::clear_mirror(uint8_t servolocalID) {
+  if (servolocalID > ID_MAX) {
+    return;
+  }
+  int pair = mirror[servolocalID];
+  if (pair != NO_MIRROR) {
+    mirror[pair] = NO_MIRROR;
+    mirror[servolocalID] = NO_MIRROR;
+    orderDirty = true;
+  }
+}
+
+// 差分送信の設定
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsPoseSender::set_delta(int threshold, int refresh) {
+  // 引数チェック
+  if ((threshold < DELTA_OFF) || (refresh < 1) || (refresh > 0xFFFF)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  deltaThreshold = threshold;
+  refreshCycles = refresh;
+  for (int a = 0; a < ID_NUM; a++) {
+    forget_sent(a);
+  }
+  return RETCODE_OK;
+}
+
+const IcsDeltaStats *IcsPoseSender::get_delta_stats() { return &deltaStats; }
+
+void IcsPoseSender::reset_delta_stats() { deltaStats = IcsDeltaStats(); }
+
+// 前回送信値を忘れる（次回は必ず送信される）
+void IcsPoseSender::forget_sent(uint8_t servolocalID) {
+  lastSent[servolocalID] = -1;
+  lastResult[servolocalID] = -1;
+  sinceSent[servolocalID] = 0;
+}
+
+// 送信順の作成
+// 優先度の高い順（同じならID順）に並べ、対の関節があれば直後に入れる。
+void IcsPoseSender::build_order() {
+  bool placed[ID_NUM] = {};
+  orderNum = 0;
+
+  for (int prio = 255; prio >= 0; prio--) {
+    for (int id = 0; id < ID_NUM; id++) {
+      if (!enabled[id] || placed[id] || (priority[id] != prio)) {
+        continue;
+      }
+      order[orderNum++] = id;
+      placed[id] = true;
+
+      int pair = mirror[id];
+      if ((pair != NO_MIRROR) && enabled[pair] && !placed[pair]) {
+        order[orderNum++] = pair;
+        placed[pair] = true;
+      }
+    }
+  }
+  orderDirty = false;
+}
+
+// 送信順の取得　戻り値にサーボ数
+int IcsPoseSender::get_order(uint8_t *buf) {
+  if (orderDirty) {
+    build_order();
+  }
+  for (int a = 0; a < orderNum; a++) {
+    buf[a] = order[a];
+  }
+  return orderNum;
+}
+
+// ポーズ送信
+// 各 set_position の送信開始時刻を記録し、最初と最後の差をスキューとする。
+int IcsPoseSender::send_pose(const int *targets, int *results) {
+  if (orderDirty) {
+    build_order();
+  }
+  if (orderNum == 0) {
+    return 0;
+  }
+
+  int oknum = 0;
+  int sentnum = 0;
+  uint8_t topprio = priority[order[0]];
+  uint32_t first = 0;
+  uint32_t last = 0;
+  uint32_t lastcritical = 0;
+
+  for (int a = 0; a < orderNum; a++) {
+    uint8_t id = order[a];
+
+    // 差分送信　変化が閾値以下で、refresh 前なら省略
+    bool changed = true;
+    if ((deltaThreshold != DELTA_OFF) && (lastSent[id] >= 0)) {
+      int diff = targets[id] - lastSent[id];
+      if (diff < 0) {
+        diff = -diff;
+      }
+      changed = (diff > deltaThreshold);
+      if (!changed && (sinceSent[id] + 1 < refreshCycles)) {
+        sinceSent[id]++;
+        deltaStats.skipped++;
+        if (deltaStats.sent > 0) {
+          deltaStats.savedUs += deltaStats.sendUs / deltaStats.sent;
+        }
+        if (results != nullptr) {
+          results[id] = lastResult[id];
+        }
+        if (lastResult[id] >= 0) {
+          oknum++;
+        }
+        continue;
+      }
+    }
+
+    uint32_t now = us_ticker_read();
+    if (sentnum == 0) {
+      first = now;
+      lastcritical = now;
+    }
+    sentnum++;
+    last = now;
+    if (priority[id] == topprio) {
+      lastcritical = now;
+    }
+
+    int retval = ics->set_position(id, targets[id]);
+    if (results != nullptr) {
+      results[id] = retval;
+    }
+    if (retval >= 0) {
+      oknum++;
+    }
+
+    deltaStats.sendUs += us_ticker_read() - now;
+    deltaStats.sent++;
+    if (!changed) {
+      deltaStats.refreshed++;
+    }
+    // 失敗したサーボは次回必ず送り直す
+    lastSent[id] = (retval >= 0) ? targets[id] : -1;
+    lastResult[id] = retval;
+    sinceSent[id] = 0;
+  }
+
+  // 全サーボ省略した回はスキュー統計に含めない
+  if (sentnum == 0) {
+    return oknum;
+  }
+
+  uint32_t skew = last - first;
+  uint32_t skewcritical = lastcritical - first;
+  if ((stats.count == 0) || (skew < stats.min)) {
+    stats.min = skew;
+  }
+  if (skew > stats.max) {
+    stats.max = skew;
+  }
+  if (skewcritical > stats.maxCritical) {
+    stats.maxCritical = skewcritical;
+  }
+  stats.last = skew;
+  stats.lastCritical = skewcritical;
+  stats.sum += skew;
+  stats.count++;
+
+  return oknum;
+}
+
+// スキュー統計
+const IcsSkewStats *IcsPoseSender::get_stats() { return &stats; }
+
+void IcsPoseSender::reset_stats() { stats = IcsSkewStats(); }
+
+// 現在のボーレート・サーボ数での予想スキュー（usec）
+// 1往復×(サーボ数-1)。実測値と比べて、ボーレートやサーボ数の検討に使う。
+uint32_t IcsPoseSender::predict_skew_us(IcsBusPlanner *planner) {
+  if (orderDirty) {
+    build_order();
+  }
+  if (orderNum <= 1) {
+    return 0;
+  }
+  return planner->command_us(ICS_CMD_POSITION) * (orderNum - 1);
+}
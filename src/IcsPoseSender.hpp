@@ -0,0 +1,106 @@
+#ifndef _ICS_POSE_SENDER_HPP_
+#define _ICS_POSE_SENDER_HPP_
+
+#include "IcsBusPlanner.hpp"
+#include "IcsCommunication.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// ポーズ（全サーボの目標位置）の一括送信
+// set_position を順番に送ると、最後のサーボは最初のサーボより数msec遅れて動く。
+// 送信順を優先度順に並べ替え（優先度の高い関節を連続させ、左右対の関節は
+// 隣り合わせにする）、実際の最初～最後の送信時刻差（スキュー）を計測する。
+//
+// 差分送信（set_delta）を有効にすると、前回送った値からの変化が閾値以下の
+// サーボは送信を省略する。省略が続いても refresh 回に1回は必ず送るので、
+// refresh × 制御周期 をサーボの safetimer より短くしておくこと。
+
+// スキュー統計（usec）
+struct IcsSkewStats
+{
+  uint32_t count = 0;
+  uint32_t last = 0;
+  uint32_t min = 0;
+  uint32_t max = 0;
+  uint64_t sum = 0;
+  uint32_t lastCritical = 0; // 最高優先度グループ内のスキュー
+  uint32_t maxCritical = 0;
+};
+
+// 差分送信の統計
+struct IcsDeltaStats
+{
+  uint32_t sent = 0;      // 送信したサーボ数（累計）
+  uint32_t skipped = 0;   // 省略したサーボ数（累計）
+  uint32_t refreshed = 0; // 変化は無いが refresh のため送信した数
+  uint64_t sendUs = 0;    // 送信に掛かった時間の合計
+  uint64_t savedUs = 0;   // 省略により節約できたバス時間（1往復の平均から推定）
+};
+
+class IcsPoseSender
+{
+  // パブリック変数
+public:
+  static const int NO_MIRROR = -1;
+  static const int DELTA_OFF = -1;
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+
+  bool enabled[ID_NUM] = {};
+  uint8_t priority[ID_NUM] = {};
+  int8_t mirror[ID_NUM];
+
+  uint8_t order[ID_NUM];
+  int orderNum = 0;
+  bool orderDirty = true;
+
+  IcsSkewStats stats;
+
+  // 差分送信
+  int deltaThreshold = DELTA_OFF;
+  int refreshCycles = 10;
+  int lastSent[ID_NUM];       // 前回送った目標値（-1 は未送信）
+  int lastResult[ID_NUM];     // 前回の戻り値（省略時に results へ返す）
+  uint16_t sinceSent[ID_NUM]; // 前回送信からのサイクル数
+  IcsDeltaStats deltaStats;
+
+  // パブリック関数
+public:
+  IcsPoseSender(IcsCommunication &icsref);
+
+  // 送信対象の設定
+  int add_servo(uint8_t servolocalID, uint8_t prio = 0);
+  void remove_servo(uint8_t servolocalID);
+  int set_priority(uint8_t servolocalID, uint8_t prio);
+  // 左右対の関節　組み直すと以前の相手との対は外れる
+  int set_mirror(uint8_t servolocalID_a, uint8_t servolocalID_b);
+  void clear_mirror(uint8_t servolocalID);
+
+  // 送信順（並べ替え後）
+  int get_order(uint8_t *buf);
+
+  // ポーズ送信
+  // 引数：　目標位置（ID添字）、現在位置の戻り値（ID添字、不要なら nullptr）
+  // 戻り値に送信に成功したサーボ数が入ります。
+  int send_pose(const int *targets, int *results = nullptr);
+
+  // 差分送信　threshold 以下の変化は省略、refresh サイクルに1回は必ず送る
+  //  threshold に DELTA_OFF で無効（毎回全サーボ送信）
+  int set_delta(int threshold, int refresh);
+  const IcsDeltaStats *get_delta_stats();
+  void reset_delta_stats();
+
+  // スキュー統計
+  const IcsSkewStats *get_stats();
+  void reset_stats();
+  uint32_t predict_skew_us(IcsBusPlanner *planner);
+
+  // プライベート関数
+private:
+  void build_order();
+  void forget_sent(uint8_t servolocalID);
+};
+
+#endif
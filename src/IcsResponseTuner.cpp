@@ -0,0 +1,221 @@
+#include "IcsResponseTuner.hpp"
+
+// コンストラクタ
+IcsResponseTuner::IcsResponseTuner(IcsCommunication &icsref) { ics = &icsref; }
+
+void IcsResponseTuner::set_samples(int num) {
+  if (num > 0) {
+    samples = num;
+  }
+}
+
+void IcsResponseTuner::set_margin(int steps) {
+  if ((steps >= 0) && (steps <= 2)) {
+    margin = steps;
+  }
+}
+
+// 試験通信　stretch を samples 回読み取り、返信までの平均時間を測る
+// 戻り値に返信エラーの回数、またはエラーコード（負の値）が入ります。
+int IcsResponseTuner::measure(uint8_t servolocalID, uint32_t *avg_us) {
+  int errors = 0;
+  int ref = -1;
+
+  ics->reset_turnaround_stats();
+  for (int a = 0; a < samples; a++) {
+    int val = ics->get_stretch(servolocalID);
+    if ((val < 0) || ((ref >= 0) && (val != ref))) {
+      // 返信が欠けた、または値が化けた
+      errors++;
+    } else {
+      ref = val;
+    }
+  }
+
+  const IcsTurnaroundStats *ts = ics->get_turnaround_stats();
+  if (ts->replyCount == 0) {
+    *avg_us = 0;
+    return RETCODE_ERROR_ICSREAD;
+  }
+  *avg_us = ts->replySum / ts->replyCount;
+  return errors;
+}
+
+// response だけ変えて書き込む（書き込み前に読み取らない）
+int IcsResponseTuner::write_response(uint8_t servolocalID, uint8_t *image,
+                                     int val) {
+  IcsPackedConfig cfg;
+  ics_packed_set(&cfg, ICS_FIELD_RESPONSE, val);
+  ics_encode_EEPROM_packed(image, &cfg);
+  return ics->write_EEPROMraw(servolocalID, image);
+}
+
+// EEPROMの response を読み戻す
+// 戻り値に response、またはエラーコード（負の値）が入ります。
+int IcsResponseTuner::read_response(uint8_t servolocalID) {
+  IcsPackedConfig cfg;
+  int tmpretcode = ics->get_EEPROM(servolocalID, &cfg);
+  if (tmpretcode != RETCODE_OK) {
+    return tmpretcode;
+  }
+  return ics_packed_get(&cfg, ICS_FIELD_RESPONSE);
+}
+
+// 1サーボの調整
+// 小さい値から順に試し、試験通信でエラーが出なかった最初の値を採用する。
+// どの値も通らなければ元の値に戻す。
+// 戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+int IcsResponseTuner::tune(uint8_t servolocalID, IcsResponseResult *res) {
+  uint8_t image[ICS_EEPROM_SIZE];
+  IcsPackedConfig cfg;
+  IcsResponseResult r;
+
+  // 引数チェック
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  // 元のEEPROM内容（以後の書き込みはこれを直して送る）
+  int tmpretcode = ics->read_EEPROMraw(servolocalID, image);
+  if (tmpretcode == RETCODE_OK) {
+    tmpretcode = ics_decode_EEPROM_packed(image, &cfg);
+  }
+  if (tmpretcode != RETCODE_OK) {
+    r.retcode = tmpretcode;
+    result[servolocalID] = r;
+    if (res != nullptr) {
+      *res = r;
+    }
+    return tmpretcode;
+  }
+  r.original = cfg.response;
+
+  // 元の値での計測　ここでエラーが出るなら配線側の問題なので調整しない
+  int errors = measure(servolocalID, &r.beforeUs);
+  if (errors != 0) {
+    tmpretcode = (errors < 0) ? errors : RETCODE_ERROR_RETURNDATAWRONG;
+  } else {
+    int found = r.original;
+    int current = r.original;
+
+    for (int val = RESPONSE_MIN; val < r.original; val++) {
+      // 返信が読めない値では書き込みの返信も欠けることがあるので、
+      // 書き込みの戻り値ではなく試験通信の結果で判断する
+      write_response(servolocalID, image, val);
+      r.writes++;
+      current = val;
+
+      uint32_t avg;
+      errors = measure(servolocalID, &avg);
+      if ((errors == 0) && (read_response(servolocalID) == val)) {
+        found = val;
+        break;
+      }
+      r.errors += (errors > 0) ? errors : samples;
+    }
+
+    // 余裕を足す（元の値より大きくはしない）
+    int chosen = found + margin;
+    if (chosen > r.original) {
+      chosen = r.original;
+    }
+    if (chosen != current) {
+      write_response(servolocalID, image, chosen);
+      r.writes++;
+    }
+
+    // 確認　読み戻しと試験通信
+    if (read_response(servolocalID) != chosen) {
+      tmpretcode = RETCODE_ERROR_EEPROMDATAWRONG;
+    } else if (measure(servolocalID, &r.afterUs) != 0) {
+      tmpretcode = RETCODE_ERROR_RETURNDATAWRONG;
+    } else {
+      r.chosen = chosen;
+      tmpretcode = RETCODE_OK;
+    }
+
+    // 確認できなければ元の値に戻す
+    if ((tmpretcode != RETCODE_OK) && (chosen != r.original)) {
+      write_response(servolocalID, image, r.original);
+      r.writes++;
+    }
+  }
+
+  r.retcode = tmpretcode;
+  result[servolocalID] = r;
+  if (res != nullptr) {
+    *res = r;
+  }
+  return tmpretcode;
+}
+
+// idmask の各IDを調整
+// 戻り値にRETCODE_OK（1の値）、または最初の失敗のエラーコード（負の値）
+int IcsResponseTuner::tune_all(uint32_t idmask, uint32_t *failmask) {
+  int tmpretcode = RETCODE_OK;
+  uint32_t fail = 0;
+
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    if ((idmask & (1UL << id)) == 0) {
+      continue;
+    }
+    int ret = tune(id);
+    if (ret != RETCODE_OK) {
+      fail |= 1UL << id;
+      if (tmpretcode == RETCODE_OK) {
+        tmpretcode = ret;
+      }
+    }
+  }
+
+  if (failmask != nullptr) {
+    *failmask = fail;
+  }
+  return tmpretcode;
+}
+
+const IcsResponseResult *IcsResponseTuner::get_result(uint8_t servolocalID) {
+  if ((servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return nullptr;
+  }
+  return &result[servolocalID];
+}
+
+// 調整した全サーボに1往復ずつ通信した場合に短くなった時間（usec）
+uint32_t IcsResponseTuner::saved_us() {
+  uint32_t saved = 0;
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    const IcsResponseResult *r = &result[id];
+    if ((r->chosen != 0) && (r->beforeUs > r->afterUs)) {
+      saved += r->beforeUs - r->afterUs;
+    }
+  }
+  return saved;
+}
+
+void IcsResponseTuner::show_result() {
+  int num = 0;
+
+  printf("ICS response tuning [us]\r\n");
+  for (int id = ID_MIN; id <= ID_MAX; id++) {
+    const IcsResponseResult *r = &result[id];
+    if (r->retcode == 0) {
+      continue;
+    }
+    if (r->retcode != RETCODE_OK) {
+      printf("  ID %2d: failed (%d), response %d\r\n", id, r->retcode,
+             r->original);
+      continue;
+    }
+    printf("  ID %2d: response %d -> %d, reply %lu -> %lu (errors %d, "
+           "writes %d)\r\n",
+           id, r->original, r->chosen, (unsigned long)r->beforeUs,
+           (unsigned long)r->afterUs, r->errors, r->writes);
+    num++;
+  }
+  if (num > 0) {
+    uint32_t saved = saved_us();
+    printf("  saved per bus cycle: %lu (%lu per transaction)\r\n",
+           (unsigned long)saved, (unsigned long)(saved / num));
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef _ICS_RESPONSE_TUNER_HPP_
+#define _ICS_RESPONSE_TUNER_HPP_
+
+#include "IcsCommunication.hpp"
+#include "IcsPackedConfig.hpp"
+#include "mbed.h"
+#include "stdint.h"
+
+// EEPROMの response（返信までの待ち時間、1-5）の自動調整
+// サーボごとに、今の配線・通信速度で返信が崩れない一番小さい値を探して
+// EEPROMに書き込み、読み戻しと試験通信で確かめる。
+// 試験通信はパラメータ読み取り（stretch）なので、サーボは動かない。
+// 返信までの時間は IcsCommunication のターンアラウンド計測（送信完了→返信
+// 1バイト目）の平均で比べる。
+//
+// 小さすぎる値では返信が読めなくなるので、書き込みは最初に読んだEEPROM内容を
+// 直して送る（書き込み前に読み取らない）。EEPROMの書き換え回数には限りが
+// あるため、tune はサーボ1個あたり最大（元の値 + 1）回書き込む。
+// 起動のたびではなく、配線や通信速度を変えたときに実行すること。
+
+// 調整結果（サーボごと）
+struct IcsResponseResult
+{
+  uint8_t original = 0;  // 元の response
+  uint8_t chosen = 0;    // 書き込んだ response（0 は未調整）
+  uint32_t beforeUs = 0; // 元の値での返信までの平均時間
+  uint32_t afterUs = 0;  // 調整後の返信までの平均時間
+  int errors = 0;        // 試した値で起きた返信エラーの合計
+  int writes = 0;        // EEPROM書き込み回数
+  int retcode = 0;       // tune の戻り値（0 は未実行）
+};
+
+class IcsResponseTuner
+{
+  // パブリック変数
+public:
+  static const int RESPONSE_MIN = 1;
+  static const int RESPONSE_MAX = 5;
+  static const int SAMPLES_DEFAULT = 100;
+
+  // プライベート変数
+private:
+  IcsCommunication *ics;
+  int samples = SAMPLES_DEFAULT;
+  int margin = 0;
+  IcsResponseResult result[ID_NUM];
+
+  // パブリック関数
+public:
+  IcsResponseTuner(IcsCommunication &icsref);
+
+  // 1つの値あたりの試験通信の回数
+  void set_samples(int num);
+  // 見つけた値に足す余裕（0-2）　ノイズの多い環境向け
+  void set_margin(int steps);
+
+  // 調整
+  //  戻り値にRETCODE_OK（1の値）、またはエラーコード（負の値）が入ります。
+  int tune(uint8_t servolocalID, IcsResponseResult *res = nullptr);
+  int tune_all(uint32_t idmask, uint32_t *failmask = nullptr);
+
+  // 結果
+  const IcsResponseResult *get_result(uint8_t servolocalID);
+  // 調整した全サーボに1往復ずつ通信した場合に短くなった時間（usec）
+  uint32_t saved_us();
+  void show_result();
+
+  // プライベート関数
+private:
+  int measure(uint8_t servolocalID, uint32_t *avg_us);
+  int write_response(uint8_t servolocalID, uint8_t *image, int val);
+  int read_response(uint8_t servolocalID);
+};
+
+#endif
@@ -0,0 +1,249 @@
+#include "IcsTelemetryLog.hpp"
+#include "string.h"
+
+static void put_u16(uint8_t *buf, uint16_t val) {
+  buf[0] = val;
+  buf[1] = val >> 8;
+}
+
+static void put_u32(uint8_t *buf, uint32_t val) {
+  buf[0] = val;
+  buf[1] = val >> 8;
+  buf[2] = val >> 16;
+  buf[3] = val >> 24;
+}
+
+static uint16_t get_u16(const uint8_t *buf) { return buf[0] | (buf[1] << 8); }
+
+static uint32_t get_u32(const uint8_t *buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+// コンストラクタ
+IcsTelemetryLog::IcsTelemetryLog(uint8_t *buf, uint32_t block_size,
+                                 uint32_t block_num)
+    : head(0), tail(0) {
+  blockBuf = buf;
+  blockSize = block_size;
+  blockNum = block_num;
+  // 引数チェック　ブロック数 0 は block_at で 0 除算、65535 を超えるブロックは
+  // ヘッダの使用バイト数（u16）に入らない
+  valid = (buf != nullptr) && (block_num > 0) &&
+          (block_size >= BLOCK_SIZE_MIN) && (block_size <= BLOCK_SIZE_MAX);
+}
+
+bool IcsTelemetryLog::is_valid() { return valid; }
+
+// 通し番号 count のブロック領域
+uint8_t *IcsTelemetryLog::block_at(uint32_t count) {
+  return &blockBuf[(count % blockNum) * blockSize];
+}
+
+// 新しいブロックを開始　空きが無ければ false
+bool IcsTelemetryLog::start_block(uint32_t now_us) {
+  uint32_t h = head.load(std::memory_order_relaxed);
+  uint32_t t = tail.load(std::memory_order_acquire);
+  if (h - t >= blockNum) {
+    return false;
+  }
+
+  uint8_t *block = block_at(h);
+  block[0] = ICS_TELEMETRY_TAG_BLOCK;
+  block[1] = ICS_TELEMETRY_VERSION;
+  put_u32(&block[4], seq);
+  put_u32(&block[8], now_us);
+  fill = HEADER_SIZE;
+  lastTime = now_us;
+  memset(prev, 0, sizeof(prev));
+  return true;
+}
+
+// 記録中ブロックを閉じて書き出し対象にする
+void IcsTelemetryLog::close_block() {
+  uint32_t h = head.load(std::memory_order_relaxed);
+  uint8_t *block = block_at(h);
+
+  put_u16(&block[2], fill);
+  memset(&block[fill], 0, blockSize - fill);
+  head.store(h + 1, std::memory_order_release);
+  seq++;
+  fill = 0;
+}
+
+// 記録
+bool IcsTelemetryLog::log(uint32_t now_us, uint8_t servolocalID, int position,
+                          int current, int temperature) {
+  // 引数チェック
+  if (!valid || (servolocalID < ID_MIN) || (servolocalID > ID_MAX)) {
+    return false;
+  }
+
+  int vals[3] = {position, current, temperature};
+  uint8_t mask = 0;
+  for (int a = 0; a < 3; a++) {
+    if (vals[a] >= 0) {
+      mask |= 1 << a;
+    }
+  }
+  if (mask == 0) {
+    return true;
+  }
+
+  // 入りきらなければ閉じて次のブロックへ
+  if ((fill != 0) && (fill + RECORD_MAX > blockSize)) {
+    close_block();
+  }
+  if ((fill == 0) && !start_block(now_us)) {
+    dropped++;
+    return false;
+  }
+
+  uint8_t *p = &block_at(head.load(std::memory_order_relaxed))[fill];
+  int len = 0;
+  p[len++] = (servolocalID << 3) | mask;
+  len += ics_varint_encode(now_us - lastTime, &p[len]);
+  for (int a = 0; a < 3; a++) {
+    if (mask & (1 << a)) {
+      len += ics_varint_encode(
+          ics_zigzag_encode(vals[a] - prev[servolocalID][a]), &p[len]);
+      prev[servolocalID][a] = vals[a];
+    }
+  }
+  fill += len;
+  lastTime = now_us;
+  samples++;
+
+  return true;
+}
+
+// 記録中のブロックを閉じる　記録が無ければ何もしない
+bool IcsTelemetryLog::seal() {
+  if (fill <= HEADER_SIZE) {
+    return false;
+  }
+  close_block();
+  return true;
+}
+
+uint32_t IcsTelemetryLog::pending() {
+  return head.load(std::memory_order_acquire) -
+         tail.load(std::memory_order_relaxed);
+}
+
+uint32_t IcsTelemetryLog::get_dropped() { return dropped; }
+
+uint32_t IcsTelemetryLog::get_samples() { return samples; }
+
+// ファイルへ書き出し（ブロック単位）
+int IcsTelemetryLog::flush(FILE *fp) {
+  uint32_t h = head.load(std::memory_order_acquire);
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  int written = 0;
+
+  while (t != h) {
+    if (fwrite(block_at(t), 1, blockSize, fp) != blockSize) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    t++;
+    tail.store(t, std::memory_order_release);
+    written++;
+  }
+
+  return written;
+}
+
+#if defined(__MBED__)
+// ブロックデバイスの書き出し先頭アドレス（消去ブロック境界）
+void IcsTelemetryLog::set_blockdevice_addr(uint64_t addr) { bdAddr = addr; }
+
+// ブロックデバイスへ書き出し（低優先度スレッドから呼ぶ）
+// 消去ブロックの先頭に来たら、その消去ブロックを消してから書く。
+// 戻り値に書き出したブロック数、またはエラーコード（負の値）が入ります。
+int IcsTelemetryLog::flush(BlockDevice *bd) {
+  uint32_t progsize = bd->get_program_size();
+  uint32_t erasesize = bd->get_erase_size();
+  uint32_t h = head.load(std::memory_order_acquire);
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  int written = 0;
+
+  if ((progsize == 0) || ((blockSize % progsize) != 0)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+
+  while (t != h) {
+    if (bdAddr + blockSize > bd->size()) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    // このブロックが掛かる消去ブロックのうち、先頭から始まるものを消す
+    for (uint64_t addr = bdAddr; addr < bdAddr + blockSize;) {
+      uint64_t next = (addr / erasesize + 1) * erasesize;
+      if ((addr % erasesize) == 0) {
+        if (bd->erase(addr, erasesize) != 0) {
+          return RETCODE_ERROR_ICSWRITE;
+        }
+      }
+      addr = next;
+    }
+    if (bd->program(block_at(t), bdAddr, blockSize) != 0) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    t++;
+    tail.store(t, std::memory_order_release);
+    bdAddr += blockSize;
+    written++;
+  }
+
+  return written;
+}
+#endif
+
+// 1ブロックの解釈
+int IcsTelemetryLog::decode_block(const uint8_t *block, uint32_t size,
+                                  IcsTelemetrySampleFn fn, void *ctx) {
+  if ((size < HEADER_SIZE) || (block[0] != ICS_TELEMETRY_TAG_BLOCK) ||
+      (block[1] != ICS_TELEMETRY_VERSION)) {
+    return RETCODE_ERROR_RETURNDATAWRONG;
+  }
+  uint32_t used = get_u16(&block[2]);
+  if ((used < HEADER_SIZE) || (used > size)) {
+    return RETCODE_ERROR_RETURNDATAWRONG;
+  }
+
+  uint32_t time = get_u32(&block[8]);
+  int32_t prev[ID_NUM][3] = {};
+  uint32_t pos = HEADER_SIZE;
+  int num = 0;
+
+  while (pos < used) {
+    uint8_t id = block[pos] >> 3;
+    uint8_t mask = block[pos] & 0x07;
+    pos++;
+
+    uint32_t val;
+    int len = ics_varint_decode(&block[pos], used - pos, &val);
+    if (len == 0) {
+      return RETCODE_ERROR_RETURNDATAWRONG;
+    }
+    pos += len;
+    time += val;
+
+    int vals[3] = {NO_VALUE, NO_VALUE, NO_VALUE};
+    for (int a = 0; a < 3; a++) {
+      if ((mask & (1 << a)) == 0) {
+        continue;
+      }
+      len = ics_varint_decode(&block[pos], used - pos, &val);
+      if (len == 0) {
+        return RETCODE_ERROR_RETURNDATAWRONG;
+      }
+      pos += len;
+      prev[id][a] += ics_zigzag_decode(val);
+      vals[a] = prev[id][a];
+    }
+
+    fn(ctx, time, id, vals[0], vals[1], vals[2]);
+    num++;
+  }
+
+  return num;
+}
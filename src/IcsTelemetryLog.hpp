@@ -0,0 +1,114 @@
+#ifndef _ICS_TELEMETRY_LOG_HPP_
+#define _ICS_TELEMETRY_LOG_HPP_
+
+#include "IcsDefine.hpp"
+#include "IcsVarint.hpp"
+#include "stdint.h"
+#include "stdio.h"
+#include <atomic>
+
+#if defined(__MBED__)
+#include "mbed.h"
+#endif
+
+// サーボの位置・電流・温度の長時間記録（テレメトリログ）
+// サンプルをIDごとの前回値との差分 + varint で圧縮し、RAM上の固定長ブロックに
+// 詰める。一杯になったブロックは、低優先度スレッド等から flush でファイル/
+// ブロックデバイスへ書き出す（記録側1、書き出し側1のロックフリー構成）。
+// 記録側は待たない。空きブロックが無いときはサンプルを捨てて件数を数える。
+// 使用メモリは渡したバッファ（ブロックサイズ × ブロック数）のみ。
+//
+// ブロックフォーマット（リトルエンディアン）
+//  ヘッダ: u8 0xA7, u8 バージョン, u16 使用バイト数（ヘッダ含む）,
+//          u32 ブロック通し番号, u32 ブロック先頭時刻[usec]
+//  記録:   u8 (ID << 3 | 項目ビット), varint 前記録からの時刻差[usec],
+//          項目ビットの立っている項目ごとに zigzag varint 前回値との差
+//          （項目ビット 1:位置 2:電流 4:温度）
+//  前回値はブロックごとに 0 から始まるので、各ブロックは単独で解釈できる。
+//  使用バイト数より後ろは 0 埋め。
+
+static const uint8_t ICS_TELEMETRY_TAG_BLOCK = 0xA7;
+static const uint8_t ICS_TELEMETRY_VERSION = 1;
+
+static const uint8_t ICS_TELEMETRY_POSITION = 0x01;
+static const uint8_t ICS_TELEMETRY_CURRENT = 0x02;
+static const uint8_t ICS_TELEMETRY_TEMPERATURE = 0x04;
+
+// 解釈したサンプルの受け取り関数（記録されていない項目は -1）
+typedef void (*IcsTelemetrySampleFn)(void *ctx, uint32_t time_us, uint8_t id,
+                                     int position, int current,
+                                     int temperature);
+
+class IcsTelemetryLog
+{
+  // パブリック変数
+public:
+  static const int HEADER_SIZE = 12;
+  static const int RECORD_MAX = 1 + ICS_VARINT_MAX * 4;
+  static const int NO_VALUE = -1;
+  // ブロックサイズの範囲（使用バイト数を u16 で記録するため 65535 まで）
+  static const uint32_t BLOCK_SIZE_MIN = HEADER_SIZE + RECORD_MAX;
+  static const uint32_t BLOCK_SIZE_MAX = 0xFFFF;
+
+  // プライベート変数
+private:
+  uint8_t *blockBuf;
+  uint32_t blockSize;
+  uint32_t blockNum;
+  bool valid; // コンストラクタの引数が正しいか（false なら何も記録しない）
+  std::atomic<uint32_t> head; // 記録側が進める（書き終わったブロック数）
+  std::atomic<uint32_t> tail; // 書き出し側が進める（書き出したブロック数）
+
+  // 記録中ブロック
+  uint32_t fill = 0;     // 使用バイト数（0 は未開始）
+  uint32_t lastTime = 0;
+  uint32_t seq = 0;
+  int16_t prev[ID_NUM][3];
+
+  uint32_t dropped = 0;
+  uint32_t samples = 0;
+  uint64_t bdAddr = 0;
+
+  // パブリック関数
+public:
+  // 引数：　ブロック領域、ブロックサイズ（byte）、ブロック数
+  // （静的に確保して渡す。ブロックデバイスに書く場合は program size の倍数に）
+  // ブロックサイズが BLOCK_SIZE_MIN～BLOCK_SIZE_MAX の範囲外、またはブロック数が
+  // 0 の場合は使用できない（is_valid が false、log は常に false を返す）
+  IcsTelemetryLog(uint8_t *buf, uint32_t block_size, uint32_t block_num);
+  bool is_valid();
+
+  // 記録（制御周期から呼ぶ、待たない）
+  //  負の値（エラーコード、NO_VALUE）の項目は記録しない
+  //  戻り値に記録できたら true、空きブロックが無く捨てたら false
+  bool log(uint32_t now_us, uint8_t servolocalID, int position,
+           int current = NO_VALUE, int temperature = NO_VALUE);
+  // 記録中のブロックを途中で閉じて、書き出し対象にする（終了前など）
+  bool seal();
+
+  // 状態
+  uint32_t pending(); // 書き出し待ちブロック数
+  uint32_t get_dropped();
+  uint32_t get_samples();
+
+  // 書き出し（低優先度スレッドから呼ぶ）
+  // 戻り値に書き出したブロック数、またはエラーコード（負の値）
+  int flush(FILE *fp);
+#if defined(__MBED__)
+  void set_blockdevice_addr(uint64_t addr);
+  int flush(BlockDevice *bd);
+#endif
+
+  // 1ブロックの解釈（ホスト側のツール用）
+  // 戻り値に解釈したサンプル数、またはエラーコード（負の値）
+  static int decode_block(const uint8_t *block, uint32_t size,
+                          IcsTelemetrySampleFn fn, void *ctx);
+
+  // プライベート関数
+private:
+  uint8_t *block_at(uint32_t count);
+  bool start_block(uint32_t now_us);
+  void close_block();
+};
+
+#endif
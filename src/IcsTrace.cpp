@@ -0,0 +1,205 @@
+#include "IcsTrace.hpp"
+
+// コンストラクタ
+IcsTrace::IcsTrace(uint8_t *buf, uint32_t size)
+    : ringBuf(buf), ringSize(size), head(0), tail(0) {}
+
+// 記録の有効・無効
+void IcsTrace::enable(bool en) { enabled = en; }
+
+bool IcsTrace::is_enabled() { return enabled; }
+
+// リングバッファ内の未書き出しバイト数
+uint32_t IcsTrace::used() {
+  uint32_t h = head.load(std::memory_order_acquire);
+  uint32_t t = tail.load(std::memory_order_acquire);
+  return (h >= t) ? (h - t) : (ringSize - t + h);
+}
+
+// 空きが無くて捨てた記録の累計件数
+uint32_t IcsTrace::get_dropped() { return dropped; }
+
+// リングバッファにバイト列を書く（空きは呼び出し側で確認済み）
+void IcsTrace::put(const uint8_t *data, uint32_t size, uint32_t *pos) {
+  uint32_t p = *pos;
+  for (uint32_t a = 0; a < size; a++) {
+    ringBuf[p] = data[a];
+    if (++p == ringSize) {
+      p = 0;
+    }
+  }
+  *pos = p;
+}
+
+// メタ記録を書く　空きが無ければ false
+bool IcsTrace::put_meta(uint32_t now_us, uint32_t brate) {
+  uint8_t hdr[1 + 4 + ICS_VARINT_MAX * 2];
+  int len = 0;
+
+  hdr[len++] = ICS_TRACE_TAG_META;
+  hdr[len++] = now_us & 0xFF;
+  hdr[len++] = (now_us >> 8) & 0xFF;
+  hdr[len++] = (now_us >> 16) & 0xFF;
+  hdr[len++] = (now_us >> 24) & 0xFF;
+  len += ics_varint_encode(brate, &hdr[len]);
+  len += ics_varint_encode(dropped, &hdr[len]);
+
+  // 1バイトは空けておく（head == tail を空とするため）
+  if (used() + len >= ringSize) {
+    return false;
+  }
+
+  uint32_t pos = head.load(std::memory_order_relaxed);
+  put(hdr, len, &pos);
+  head.store(pos, std::memory_order_release);
+
+  lastStart = now_us;
+  lastBaudrate = brate;
+  needMeta = false;
+  return true;
+}
+
+// 送信前の記録　送信バッファは送信後ゼロクリアされるので、ここで控えておく
+void IcsTrace::begin(uint32_t start_us, uint32_t brate, const uint8_t *txbuf,
+                     uint8_t txsize) {
+  if (!enabled) {
+    return;
+  }
+  if (txsize > TX_MAX) {
+    txsize = TX_MAX;
+  }
+
+  if (needMeta || (brate != lastBaudrate)) {
+    if (!put_meta(start_us, brate)) {
+      needMeta = true;
+    }
+  }
+
+  for (int a = 0; a < txsize; a++) {
+    txStage[a] = txbuf[a];
+  }
+  txStageSize = txsize;
+  txStart = start_us;
+}
+
+// 受信後の記録　1トランザクション分をまとめてリングバッファに追記する
+void IcsTrace::end(uint32_t txdone_us, uint32_t end_us, const uint8_t *rxbuf,
+                   uint8_t rxsize, uint8_t rxcount, int result) {
+  if (!enabled) {
+    return;
+  }
+  if (needMeta) {
+    // メタ記録が書けていないと時刻の基準が無いので、この記録は捨てる
+    dropped++;
+    return;
+  }
+
+  uint8_t hdr[HEADER_MAX];
+  int len = 0;
+
+  hdr[len++] = ICS_TRACE_TAG_TRANSACTION;
+  len += ics_varint_encode(txStart - lastStart, &hdr[len]);
+  hdr[len++] = txStageSize;
+  hdr[len++] = rxsize;
+  hdr[len++] = rxcount;
+  hdr[len++] = ics_trace_result_encode(result);
+  len += ics_varint_encode(txdone_us - txStart, &hdr[len]);
+  len += ics_varint_encode(end_us - txStart, &hdr[len]);
+
+  uint32_t total = len + txStageSize + rxcount;
+  if (used() + total >= ringSize) {
+    dropped++;
+    needMeta = true; // 次回、破棄件数をメタ記録で知らせる
+    return;
+  }
+
+  uint32_t pos = head.load(std::memory_order_relaxed);
+  put(hdr, len, &pos);
+  put(txStage, txStageSize, &pos);
+  put(rxbuf, rxcount, &pos);
+  head.store(pos, std::memory_order_release);
+
+  lastStart = txStart;
+}
+
+// ファイルへ書き出し（低優先度スレッドから呼ぶ）
+// 戻り値に書き出したバイト数、またはエラーコード（負の値）が入ります。
+int IcsTrace::flush(FILE *fp) {
+  uint32_t h = head.load(std::memory_order_acquire);
+  uint32_t t = tail.load(std::memory_order_relaxed);
+  int written = 0;
+
+  while (t != h) {
+    // 折り返し前までの連続領域
+    uint32_t len = (h > t) ? (h - t) : (ringSize - t);
+    if (fwrite(&ringBuf[t], 1, len, fp) != len) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    written += len;
+    t += len;
+    if (t == ringSize) {
+      t = 0;
+    }
+    tail.store(t, std::memory_order_release);
+  }
+
+  return written;
+}
+
+#if defined(__MBED__)
+// ブロックデバイスの書き出し先頭アドレス（消去ブロック境界）
+void IcsTrace::set_blockdevice_addr(uint64_t addr) { bdAddr = addr; }
+
+// ブロックデバイスへ書き出し（低優先度スレッドから呼ぶ）
+// 書き込み単位（program size）に満たない端数は、次回まで持ち越す。
+// 消去ブロックの先頭に来たら、その消去ブロックを消してから書く。
+// 戻り値に書き出したバイト数、またはエラーコード（負の値）が入ります。
+int IcsTrace::flush(BlockDevice *bd) {
+  uint32_t progsize = bd->get_program_size();
+  uint32_t erasesize = bd->get_erase_size();
+  int written = 0;
+
+  if ((progsize == 0) || (progsize > CHUNK_MAX)) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  // 1回の書き込み単位を CHUNK_MAX 以内の progsize の倍数にする
+  uint32_t chunksize = (CHUNK_MAX / progsize) * progsize;
+
+  while (used() >= progsize) {
+    uint32_t len = used();
+    if (len > chunksize) {
+      len = chunksize;
+    }
+    // 消去ブロックをまたがないようにする
+    if (len > erasesize - (bdAddr % erasesize)) {
+      len = erasesize - (bdAddr % erasesize);
+    }
+    len = (len / progsize) * progsize;
+
+    if (bdAddr + len > bd->size()) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    if ((bdAddr % erasesize) == 0) {
+      if (bd->erase(bdAddr, erasesize) != 0) {
+        return RETCODE_ERROR_ICSWRITE;
+      }
+    }
+
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    for (uint32_t a = 0; a < len; a++) {
+      chunk[a] = ringBuf[t];
+      if (++t == ringSize) {
+        t = 0;
+      }
+    }
+    if (bd->program(chunk, bdAddr, len) != 0) {
+      return RETCODE_ERROR_ICSWRITE;
+    }
+    tail.store(t, std::memory_order_release);
+    bdAddr += len;
+    written += len;
+  }
+
+  return written;
+}
+#endif
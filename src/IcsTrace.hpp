@@ -0,0 +1,108 @@
+#ifndef _ICS_TRACE_HPP_
+#define _ICS_TRACE_HPP_
+
+#include "IcsDefine.hpp"
+#include "IcsVarint.hpp"
+#include "stdint.h"
+#include "stdio.h"
+#include <atomic>
+
+#if defined(__MBED__)
+#include "mbed.h"
+#endif
+
+// ICSバス通信の記録（トレース）
+// transceive の1往復ごとに、時刻・送受信バイト・結果・時間をRAMのリングバッファに
+// バイナリで追記する。ファイル/ブロックデバイスへの書き出しは別スレッド等から
+// flush で行う（記録側1、書き出し側1のロックフリー構成）。
+// バッファが一杯の時は新しい記録を捨てて件数を数える（記録側は待たない）。
+//
+// 記録フォーマット（リトルエンディアン、varint は IcsVarint.hpp 参照）
+//  トランザクション記録:
+//   0xA5, varint 前記録からの開始時刻差[usec], u8 送信サイズ,
+//   u8 受信要求サイズ, u8 受信できたサイズ, u8 結果コード,
+//   varint 送信完了までの時間[usec], varint 全体の時間[usec],
+//   送信バイト列, 受信バイト列（受信できた分）
+//  メタ記録（最初・ボーレート変更時・記録を捨てた後に出力）:
+//   0xA6, u32 絶対時刻[usec], varint ボーレート, varint 累計破棄件数
+
+static const uint8_t ICS_TRACE_TAG_TRANSACTION = 0xA5;
+static const uint8_t ICS_TRACE_TAG_META = 0xA6;
+
+// 結果コード　RETCODE_OK は 0、エラーは -1000 からの差（-1001 → 1）
+inline uint8_t ics_trace_result_encode(int retcode) {
+  if (retcode == RETCODE_OK) {
+    return 0;
+  }
+  return (uint8_t)(-1000 - retcode);
+}
+
+inline int ics_trace_result_decode(uint8_t code) {
+  if (code == 0) {
+    return RETCODE_OK;
+  }
+  return -1000 - code;
+}
+
+class IcsTrace
+{
+  // パブリック変数
+public:
+  static const int TX_MAX = 66;
+  static const int HEADER_MAX = 1 + ICS_VARINT_MAX + 4 + ICS_VARINT_MAX * 2;
+  static const int CHUNK_MAX = 256; // ブロックデバイス書き込み単位の上限
+
+  // プライベート変数
+private:
+  uint8_t *ringBuf;
+  uint32_t ringSize;
+  std::atomic<uint32_t> head; // 記録側が進める（書き込み位置）
+  std::atomic<uint32_t> tail; // 書き出し側が進める（読み出し位置）
+
+  bool enabled = true;
+  bool needMeta = true;
+  uint32_t dropped = 0;
+  uint32_t lastStart = 0;
+  uint32_t lastBaudrate = 0;
+
+  // begin～end 間の送信内容保持
+  uint8_t txStage[TX_MAX];
+  uint8_t txStageSize = 0;
+  uint32_t txStart = 0;
+
+  // ブロックデバイス書き出し用
+  uint8_t chunk[CHUNK_MAX];
+  uint64_t bdAddr = 0;
+
+  // パブリック関数
+public:
+  // 引数：　リングバッファ領域、サイズ（静的に確保して渡す）
+  IcsTrace(uint8_t *buf, uint32_t size);
+
+  void enable(bool en);
+  bool is_enabled();
+
+  // IcsCommunication::transceive から呼ばれる
+  void begin(uint32_t start_us, uint32_t brate, const uint8_t *txbuf,
+             uint8_t txsize);
+  void end(uint32_t txdone_us, uint32_t end_us, const uint8_t *rxbuf,
+           uint8_t rxsize, uint8_t rxcount, int result);
+
+  // 状態
+  uint32_t used();
+  uint32_t get_dropped();
+
+  // 書き出し　戻り値に書き出したバイト数、またはエラーコード（負の値）
+  int flush(FILE *fp);
+#if defined(__MBED__)
+  void set_blockdevice_addr(uint64_t addr);
+  int flush(BlockDevice *bd);
+#endif
+
+  // プライベート関数
+private:
+  void put(const uint8_t *data, uint32_t size, uint32_t *pos);
+  bool put_meta(uint32_t now_us, uint32_t brate);
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef _ICS_VARINT_HPP_
+#define _ICS_VARINT_HPP_
+
+#include "stdint.h"
+
+// 可変長整数（LEB128形式、下位7bitずつ、最上位bitが継続フラグ）
+// トレースやテレメトリログの圧縮に使う。mbedに依存しない。
+
+static const int ICS_VARINT_MAX = 5; // uint32_t の最大バイト数
+
+// 符号付き値を小さい符号無し値に変換（0,-1,1,-2,... → 0,1,2,3,...）
+inline uint32_t ics_zigzag_encode(int32_t val) {
+  return ((uint32_t)val << 1) ^ (uint32_t)(val >> 31);
+}
+
+inline int32_t ics_zigzag_decode(uint32_t val) {
+  return (int32_t)(val >> 1) ^ -(int32_t)(val & 1);
+}
+
+// バッファに書き込み、書き込んだバイト数を返す
+inline int ics_varint_encode(uint32_t val, uint8_t *buf) {
+  int len = 0;
+  while (val >= 0x80) {
+    buf[len++] = (uint8_t)(val | 0x80);
+    val >>= 7;
+  }
+  buf[len++] = (uint8_t)val;
+  return len;
+}
+
+// バッファから読み取り、読んだバイト数を返す（不正・途中切れなら 0）
+inline int ics_varint_decode(const uint8_t *buf, int size, uint32_t *val) {
+  uint32_t result = 0;
+  for (int a = 0; (a < size) && (a < ICS_VARINT_MAX); a++) {
+    result |= (uint32_t)(buf[a] & 0x7F) << (7 * a);
+    if ((buf[a] & 0x80) == 0) {
+      *val = result;
+      return a + 1;
+    }
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,326 @@
+// IcsCodec ホスト用ベンチマーク・往復検証
+// 疑似サーボ（送信フレームに ICS の仕様通り返信する）を相手に、
+// 各コマンドの送信データ作成～返信解釈を繰り返し、1回あたりの時間を表示する。
+// 計測前に EEPROMdata の全項目について、正当な値の全範囲で
+// 書き込み（ics_encode_EEPROM）→読み取り（ics_decode_EEPROM）の往復を検証し、
+// 一致しなければ終了コード 1 で終わる（コーデック高速化時の確認用）。
+// 省メモリ版（IcsPackedConfig）の変換も、EEPROMdata 版と同じ結果になるか確認する。
+//
+// ビルド例（リポジトリ直下で）:
+//   g++ -O2 -Isrc tools/ics_codec_bench.cpp src/IcsCodec.cpp src/IcsPackedConfig.cpp -o ics_codec_bench
+// 実行:
+//   ./ics_codec_bench [繰り返し回数]
+
+#include "IcsCodec.hpp"
+#include "IcsPackedConfig.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 疑似サーボ　EEPROMイメージとパラメータを持ち、送信フレームに返信を作る
+struct FakeServo
+{
+  uint8_t id = 5;
+  int position = POS_CENTER;
+  uint8_t param[6] = {0, 60, 100, 20, 70, 0};
+  uint8_t eeprom[ICS_EEPROM_SIZE];
+
+  FakeServo() {
+    // 実機から読んだ値に近い初期イメージ（4bitずつ）
+    static const uint8_t image[ICS_EEPROM_SIZE] = {
+        0x0, 0x0, 0x5, 0xA, 0x7, 0x8, 0x7, 0xF, 0x0, 0x1, 0x0, 0x2,
+        0x0, 0x2, 0xF, 0xA, 0x0, 0x0, 0x0, 0x8, 0x2, 0xB, 0x0, 0x0,
+        0x0, 0xE, 0x0, 0x0, 0x0, 0xA, 0x5, 0x0, 0x3, 0xF, 0x0, 0x0,
+        0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0,
+        0x0, 0x0, 0x0, 0x0, 0x0, 0x1, 0x0, 0x0, 0x0, 0x0, 0x0, 0x5,
+        0x3, 0xC, 0x3, 0xC, 0x3, 0xC};
+    memcpy(eeprom, image, sizeof(eeprom));
+    // 範囲外の初期値を正当な値に（poslimithigh 11000, poslimitlow 3600）
+    eeprom[18] = 0x2;
+    eeprom[19] = 0xA;
+    eeprom[20] = 0xF;
+    eeprom[21] = 0x8;
+    eeprom[22] = 0x0;
+    eeprom[23] = 0xE;
+    eeprom[24] = 0x1;
+    eeprom[25] = 0x0;
+  }
+
+  // 返信作成　戻り値に返信バイト数
+  int reply(const uint8_t *tx, int txsize, uint8_t *rx) {
+    uint8_t head = tx[0] & 0b11100000;
+    if ((tx[0] & 0b00011111) != id) {
+      return 0;
+    }
+    if ((head == ICS_CMD_HEAD_POSITION) && (txsize == 3)) {
+      int val = (tx[1] << 7) + tx[2];
+      if (val != 0) {
+        position = val;
+      }
+      rx[0] = id;
+      rx[1] = position >> 7;
+      rx[2] = position & 0x7F;
+      return 3;
+    }
+    if ((head == ICS_CMD_HEAD_READ) && (txsize == 2)) {
+      if (tx[1] == ICS_SC_EEPROM) {
+        memcpy(rx, eeprom, ICS_EEPROM_SIZE);
+        rx[0] = 0x20 | id;
+        rx[1] = ICS_SC_EEPROM;
+        return ICS_EEPROM_SIZE;
+      }
+      rx[0] = 0x20 | id;
+      rx[1] = tx[1];
+      rx[2] = param[tx[1]];
+      return 3;
+    }
+    if ((head == ICS_CMD_HEAD_WRITE) && (txsize == ICS_EEPROM_SIZE)) {
+      memcpy(&eeprom[2], &tx[2], ICS_EEPROM_SIZE - 2);
+      rx[0] = 0x40 | id;
+      rx[1] = ICS_SC_EEPROM;
+      return 2;
+    }
+    if ((head == ICS_CMD_HEAD_WRITE) && (txsize == 3)) {
+      param[tx[1]] = tx[2];
+      rx[0] = 0x40 | id;
+      rx[1] = tx[1];
+      rx[2] = tx[2];
+      return 3;
+    }
+    return 0;
+  }
+};
+
+static FakeServo servo;
+static int failnum = 0;
+
+// set_EEPROM と同じ手順で1項目だけ書き、get_EEPROM と同じ手順で読む
+static bool eeprom_roundtrip(int EEPROMdata::*field, int val) {
+  uint8_t txbuf[ICS_EEPROM_SIZE];
+  uint8_t rxbuf[ICS_EEPROM_SIZE];
+  uint8_t packedbuf[ICS_EEPROM_SIZE];
+  EEPROMdata before, w, r, pr;
+  IcsPackedConfig pw, prd;
+
+  ics_encode_read_param(txbuf, servo.id, ICS_SC_EEPROM);
+  servo.reply(txbuf, 2, rxbuf);
+  if (ics_check_EEPROM_header(rxbuf, servo.id) != RETCODE_OK) {
+    return false;
+  }
+  ics_decode_EEPROM(rxbuf, &before);
+
+  w.*field = val;
+  if (ics_check_EEPROMdata(&w) != RETCODE_OK) {
+    return false;
+  }
+  memcpy(txbuf, rxbuf, sizeof(txbuf));
+  txbuf[0] = ICS_CMD_HEAD_WRITE | servo.id;
+  txbuf[1] = ICS_SC_EEPROM;
+  memcpy(packedbuf, txbuf, sizeof(packedbuf));
+  ics_encode_EEPROM(txbuf, &w);
+  // 省メモリ版の書き込みデータが同じになること
+  if (ics_packed_from_EEPROMdata(&w, &pw) != RETCODE_OK) {
+    return false;
+  }
+  ics_encode_EEPROM_packed(packedbuf, &pw);
+  if (memcmp(txbuf, packedbuf, sizeof(txbuf)) != 0) {
+    return false;
+  }
+  servo.reply(txbuf, ICS_EEPROM_SIZE, rxbuf);
+
+  ics_encode_read_param(txbuf, servo.id, ICS_SC_EEPROM);
+  servo.reply(txbuf, 2, rxbuf);
+  ics_decode_EEPROM(rxbuf, &r);
+
+  // 省メモリ版の読み取り結果が同じになること
+  ics_decode_EEPROM_packed(rxbuf, &prd);
+  ics_packed_to_EEPROMdata(&prd, &pr);
+  if (memcmp(&r, &pr, sizeof(EEPROMdata)) != 0) {
+    return false;
+  }
+
+  // 書いた項目は一致、それ以外は変わらないこと
+  before.*field = val;
+  return memcmp(&before, &r, sizeof(EEPROMdata)) == 0;
+}
+
+static void check_field(const char *name, int EEPROMdata::*field, int low,
+                        int high) {
+  for (int val = low; val <= high; val++) {
+    if (!eeprom_roundtrip(field, val)) {
+      printf("FAIL: EEPROM %s = %d\r\n", name, val);
+      failnum++;
+      return;
+    }
+  }
+}
+
+static void check_values(const char *name, int EEPROMdata::*field,
+                         const int *vals, int num) {
+  for (int a = 0; a < num; a++) {
+    if (!eeprom_roundtrip(field, vals[a])) {
+      printf("FAIL: EEPROM %s = %d\r\n", name, vals[a]);
+      failnum++;
+      return;
+    }
+  }
+}
+
+static void verify() {
+  static const int flags[] = {0, 1, 0};
+  static const int speeds[] = {115200, 625000, 1250000};
+
+  check_field("stretch", &EEPROMdata::stretch, 1, 127);
+  check_field("speed", &EEPROMdata::speed, 1, 127);
+  check_field("punch", &EEPROMdata::punch, 0, 10);
+  check_field("deadband", &EEPROMdata::deadband, 0, 16);
+  check_field("dumping", &EEPROMdata::dumping, 1, 255);
+  check_field("safetimer", &EEPROMdata::safetimer, 1, 255);
+  check_values("flag_slave", &EEPROMdata::flag_slave, flags, 3);
+  check_values("flag_rotation", &EEPROMdata::flag_rotation, flags, 3);
+  check_values("flag_pwminh", &EEPROMdata::flag_pwminh, flags, 3);
+  check_values("flag_reverse", &EEPROMdata::flag_reverse, flags, 3);
+  // flag_free は読み出し専用なので書き込まない
+  check_field("poslimithigh", &EEPROMdata::poslimithigh, 8000, POS_MAX);
+  check_field("poslimitlow", &EEPROMdata::poslimitlow, POS_MIN, 7000);
+  check_values("commspeed", &EEPROMdata::commspeed, speeds, 3);
+  check_field("temperaturelimit", &EEPROMdata::temperaturelimit, 1, 127);
+  check_field("currentlimit", &EEPROMdata::currentlimit, 1, 63);
+  check_field("response", &EEPROMdata::response, 1, 5);
+  check_field("offset", &EEPROMdata::offset, -127, 127);
+  check_field("ID", &EEPROMdata::ID, 0, ID_MAX);
+  eeprom_roundtrip(&EEPROMdata::ID, servo.id); // 元のIDに戻しておく
+  check_field("charstretch1", &EEPROMdata::charstretch1, 1, 127);
+  check_field("charstretch2", &EEPROMdata::charstretch2, 1, 127);
+  check_field("charstretch3", &EEPROMdata::charstretch3, 1, 127);
+
+  // ポジション、パラメータ
+  for (int val = POS_MIN; val <= POS_MAX; val++) {
+    uint8_t tx[3], rx[ICS_EEPROM_SIZE];
+    ics_encode_position(tx, servo.id, val);
+    servo.reply(tx, 3, rx);
+    if (ics_decode_position(rx, servo.id) != val) {
+      printf("FAIL: position %d\r\n", val);
+      failnum++;
+      break;
+    }
+  }
+  for (int val = 1; val <= 127; val++) {
+    uint8_t tx[3], rx[ICS_EEPROM_SIZE];
+    ics_encode_write_param(tx, servo.id, ICS_SC_STRETCH, val);
+    servo.reply(tx, 3, rx);
+    if (ics_decode_write_param(rx, servo.id, ICS_SC_STRETCH) != RETCODE_OK) {
+      printf("FAIL: write_Param %d\r\n", val);
+      failnum++;
+      break;
+    }
+    ics_encode_read_param(tx, servo.id, ICS_SC_STRETCH);
+    servo.reply(tx, 2, rx);
+    if (ics_decode_read_param(rx, servo.id, ICS_SC_STRETCH) != val) {
+      printf("FAIL: read_Param %d\r\n", val);
+      failnum++;
+      break;
+    }
+  }
+}
+
+// 計測　fn を num 回実行し、1回あたりの nsec を表示
+template <class F> static void bench(const char *name, long num, F fn) {
+  volatile long sink = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  for (long n = 0; n < num; n++) {
+    sink += fn(n);
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  double ns =
+      std::chrono::duration<double, std::nano>(t1 - t0).count() / num;
+  printf("%-24s %8.1f ns/op\r\n", name, ns);
+}
+
+int main(int argc, char **argv) {
+  long num = 2000000;
+  if (argc > 1) {
+    num = atol(argv[1]);
+  }
+
+  verify();
+  if (failnum > 0) {
+    printf("round-trip verification failed: %d\r\n", failnum);
+    return 1;
+  }
+  printf("round-trip verification passed\r\n");
+
+  static uint8_t eeimage[ICS_EEPROM_SIZE];
+  {
+    uint8_t tx[2];
+    ics_encode_read_param(tx, servo.id, ICS_SC_EEPROM);
+    servo.reply(tx, 2, eeimage);
+  }
+
+  bench("set_position", num, [](long n) {
+    uint8_t tx[3], rx[ICS_EEPROM_SIZE];
+    ics_encode_position(tx, servo.id, POS_MIN + (n & 0x1FFF));
+    servo.reply(tx, 3, rx);
+    return ics_decode_position(rx, servo.id);
+  });
+  bench("read_Param", num, [](long n) {
+    uint8_t tx[2], rx[ICS_EEPROM_SIZE];
+    ics_encode_read_param(tx, servo.id, 1 + (n & 3));
+    servo.reply(tx, 2, rx);
+    return ics_decode_read_param(rx, servo.id, 1 + (n & 3));
+  });
+  bench("write_Param", num, [](long n) {
+    uint8_t tx[3], rx[ICS_EEPROM_SIZE];
+    ics_encode_write_param(tx, servo.id, ICS_SC_SPEED, 1 + (n & 0x7F));
+    servo.reply(tx, 3, rx);
+    return ics_decode_write_param(rx, servo.id, ICS_SC_SPEED);
+  });
+  bench("get_EEPROM decode", num, [](long n) {
+    EEPROMdata edata;
+    eeimage[5] = n & 0x0F; // stretch 下位4bitを変える
+    if (ics_check_EEPROM_header(eeimage, servo.id) != RETCODE_OK) {
+      return 0;
+    }
+    ics_decode_EEPROM(eeimage, &edata);
+    return edata.stretch;
+  });
+  bench("get_EEPROM decode packed", num, [](long n) {
+    IcsPackedConfig cfg;
+    eeimage[5] = n & 0x0F;
+    if (ics_check_EEPROM_header(eeimage, servo.id) != RETCODE_OK) {
+      return 0;
+    }
+    ics_decode_EEPROM_packed(eeimage, &cfg);
+    return (int)cfg.stretch;
+  });
+  bench("set_EEPROM encode", num, [](long n) {
+    uint8_t tx[ICS_EEPROM_SIZE];
+    EEPROMdata edata;
+    edata.stretch = 1 + (n & 0x3F);
+    edata.speed = 1 + (n & 0x7F);
+    edata.offset = (n & 0x3F) - 32;
+    memcpy(tx, eeimage, sizeof(tx));
+    ics_encode_EEPROM(tx, &edata);
+    return (int)tx[5];
+  });
+  bench("set_EEPROM encode packed", num, [](long n) {
+    uint8_t tx[ICS_EEPROM_SIZE];
+    IcsPackedConfig cfg;
+    ics_packed_set(&cfg, ICS_FIELD_STRETCH, 1 + (n & 0x3F));
+    ics_packed_set(&cfg, ICS_FIELD_SPEED, 1 + (n & 0x7F));
+    ics_packed_set(&cfg, ICS_FIELD_OFFSET, (n & 0x3F) - 32);
+    memcpy(tx, eeimage, sizeof(tx));
+    ics_encode_EEPROM_packed(tx, &cfg);
+    return (int)tx[5];
+  });
+  bench("check_EEPROMdata", num, [](long n) {
+    EEPROMdata edata;
+    ics_decode_EEPROM(eeimage, &edata);
+    edata.punch = n & 7;
+    return ics_check_EEPROMdata(&edata);
+  });
+
+  return 0;
+}
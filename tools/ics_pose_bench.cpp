@@ -0,0 +1,62 @@
+// IcsAngleConverter ホスト用ベンチマーク
+// 32軸ポーズの 角度→ポジション、ポジション→角度 変換が毎秒何ポーズできるかを測る。
+//
+// ビルド例（リポジトリ直下で）:
+//   g++ -O2 -Isrc tools/ics_pose_bench.cpp src/IcsAngleConverter.cpp -o ics_pose_bench
+// 実行:
+//   ./ics_pose_bench [ポーズ数]
+
+#include "IcsAngleConverter.hpp"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv) {
+  long posenum = 1000000;
+  if (argc > 1) {
+    posenum = atol(argv[1]);
+  }
+
+  IcsAngleConverter conv;
+  for (int a = 0; a < ID_NUM; a++) {
+    conv.set_joint(a, (a % 7) * 10 - 30, (a % 2) == 1, 4000, 11000);
+  }
+
+  // 入力ポーズ　-2.5rad ～ +2.5rad 付近（一部はリミットでクランプされる）
+  static int32_t rad[ID_NUM];
+  static int pos[ID_NUM];
+  static int32_t back[ID_NUM];
+  for (int a = 0; a < ID_NUM; a++) {
+    rad[a] = (int32_t)((a - ID_NUM / 2) * (ICS_Q16_ONE * 5 / ID_NUM));
+  }
+
+  long clampnum = 0;
+  long checksum = 0;
+
+  auto t0 = std::chrono::steady_clock::now();
+  for (long n = 0; n < posenum; n++) {
+    rad[n % ID_NUM] += 1; // 最適化で消されないよう毎回入力を変える
+    clampnum += conv.to_position(rad, pos, ID_NUM);
+    checksum += pos[n % ID_NUM];
+  }
+  auto t1 = std::chrono::steady_clock::now();
+  for (long n = 0; n < posenum; n++) {
+    pos[n % ID_NUM] ^= 1;
+    conv.to_angle(pos, back, ID_NUM);
+    checksum += back[n % ID_NUM];
+  }
+  auto t2 = std::chrono::steady_clock::now();
+
+  double sec_to = std::chrono::duration<double>(t1 - t0).count();
+  double sec_from = std::chrono::duration<double>(t2 - t1).count();
+
+  printf("poses: %ld x %d joints\r\n", posenum, ID_NUM);
+  printf("rad -> pos: %.0f poses/s (%.1f ns/pose, clamped %ld)\r\n",
+         posenum / sec_to, sec_to * 1e9 / posenum, clampnum);
+  printf("pos -> rad: %.0f poses/s (%.1f ns/pose)\r\n", posenum / sec_from,
+         sec_from * 1e9 / posenum);
+  printf("(checksum %ld)\r\n", checksum);
+
+  return 0;
+}
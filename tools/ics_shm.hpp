@@ -0,0 +1,234 @@
+#ifndef _ICS_SHM_HPP_
+#define _ICS_SHM_HPP_
+
+// ICSサーボサーバ（ics_shm_server）の共有メモリ表　Linux用
+// サーバがシリアルポートを占有し、IDごとの状態（位置・電流・温度・エラー数）を
+// 書き込む。各プロセス（計画・記録・安全監視など）は表を mmap して、
+// システムコール無しで状態を読み、目標位置を書き込む。
+//
+// 排他はシーケンスカウンタ（seqlock）で行う。
+//  ・状態：書き込みはサーバのみ。読む側は seq が奇数（書き込み中）か、
+//    読む前後で seq が変わっていたら読み直す。回数に上限を設け、読めなければ
+//    失敗を返す（サーバが書き込み途中で kill された場合も止まらない）。
+//    サーバが動いているかは heartbeat が進んでいるかで判断する。
+//  ・指令：複数のクライアントが書くので、seq を偶数→奇数に CAS できた
+//    クライアントだけが書き込む。サーバは状態と同じ手順で読むが、回数に上限を
+//    設け、読めなければ前回読めた指令を使い続ける（バス全体を止めない）。
+//    書き込み途中でクライアントが止まり（kill 等）、seq が ICS_SHM_STUCK_US 以上
+//    奇数のままなら、サーバが前回読めた指令を書き戻して seq を偶数に戻す。
+//    （それより長く止まってから再開したクライアントの書き込みは、読む側で
+//    mode と target の組が食い違うことがある）
+// 各項目は std::atomic（relaxed）なので、読み書きは途中の値にならない。
+
+#include "IcsDefine.hpp"
+
+#include <atomic>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const uint32_t ICS_SHM_MAGIC = 0x49435348; // "ICSH"
+static const uint32_t ICS_SHM_VERSION = 2;
+static const char *const ICS_SHM_NAME_DEFAULT = "/ics_servo";
+
+// 指令の読み出しの試行回数、書き込み途中で止まったとみなす時間
+static const int ICS_SHM_READ_TRIES = 64;
+static const uint32_t ICS_SHM_STUCK_US = 100000;
+
+// 指令モード
+//  MODE_NONE では、ICS3.6のIDは位置読み取りの1往復を行い、3.5のIDとは通信しない
+//  （3.5には脱力させずに位置を読むコマンドが無いため。位置は最後の値のまま）
+static const int32_t ICS_SHM_MODE_NONE = 0;     // 移動指令なし
+static const int32_t ICS_SHM_MODE_POSITION = 1; // target へ移動
+static const int32_t ICS_SHM_MODE_FREE = 2;     // 脱力
+
+// IDごとの状態（サーバが書く）　キャッシュライン単位で分ける
+struct alignas(64) IcsShmState
+{
+  std::atomic<uint32_t> seq;
+  std::atomic<int32_t> position;    // 最新の現在位置（未取得は -1）
+  std::atomic<int32_t> current;     // 最新の電流値（ICS生値、未取得は -1）
+  std::atomic<int32_t> temperature; // 最新の温度値（ICS生値、未取得は -1）
+  std::atomic<uint32_t> okCount;    // 成功した往復数
+  std::atomic<uint32_t> errorCount; // 失敗した往復数（返信なし・返信不正）
+  std::atomic<uint32_t> updateTime; // 最終更新時刻（CLOCK_MONOTONIC, usec 下位32bit）
+};
+
+// IDごとの指令（クライアントが書く）
+struct alignas(64) IcsShmCommand
+{
+  std::atomic<uint32_t> seq;
+  std::atomic<int32_t> mode;
+  std::atomic<int32_t> target;
+};
+
+// 共有メモリ表全体
+struct IcsShmTable
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t idmask;   // サーバが通信するID（1 << ID）
+  uint32_t baudrate;
+  std::atomic<uint32_t> presentMask; // 返信のあるID（起動時と再確認で検出）
+  std::atomic<uint32_t> v36Mask;     // そのうちICS3.6のID
+  std::atomic<uint32_t> heartbeat; // ループ回数（止まっていればサーバ停止）
+  std::atomic<uint32_t> loopUs;    // 直近のループ周期
+  IcsShmState state[ID_NUM];
+  IcsShmCommand command[ID_NUM];
+};
+
+// 状態の読み出し結果
+struct IcsShmStateValue
+{
+  int32_t position;
+  int32_t current;
+  int32_t temperature;
+  uint32_t okCount;
+  uint32_t errorCount;
+  uint32_t updateTime;
+};
+
+// 共有メモリ表を開く　create ならサーバ用に作成して初期化する
+// 失敗時は nullptr
+inline IcsShmTable *ics_shm_open(const char *name, bool create) {
+  int fd = shm_open(name, create ? (O_RDWR | O_CREAT) : O_RDWR, 0666);
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (create && (ftruncate(fd, sizeof(IcsShmTable)) != 0)) {
+    close(fd);
+    return nullptr;
+  }
+  void *p = mmap(nullptr, sizeof(IcsShmTable), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    return nullptr;
+  }
+
+  IcsShmTable *table = (IcsShmTable *)p;
+  if (!create && ((table->magic != ICS_SHM_MAGIC) ||
+                  (table->version != ICS_SHM_VERSION))) {
+    munmap(p, sizeof(IcsShmTable));
+    return nullptr;
+  }
+  return table;
+}
+
+inline void ics_shm_close(IcsShmTable *table) {
+  munmap((void *)table, sizeof(IcsShmTable));
+}
+
+// 状態の書き込み（サーバ専用）
+inline void ics_shm_publish(IcsShmState *st, const IcsShmStateValue *val) {
+  uint32_t seq = st->seq.load(std::memory_order_relaxed);
+  st->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  st->position.store(val->position, std::memory_order_relaxed);
+  st->current.store(val->current, std::memory_order_relaxed);
+  st->temperature.store(val->temperature, std::memory_order_relaxed);
+  st->okCount.store(val->okCount, std::memory_order_relaxed);
+  st->errorCount.store(val->errorCount, std::memory_order_relaxed);
+  st->updateTime.store(val->updateTime, std::memory_order_relaxed);
+
+  st->seq.store(seq + 2, std::memory_order_release);
+}
+
+// 状態の読み出し　書き込み中なら tries 回まで読み直す
+// （サーバが書き込み途中で止まると seq は奇数のままなので、回数に上限を設ける）
+// 戻り値に読めたら true。*seq に読み出した時点の seq（同じ値なら前回から
+// 更新なし）、読めなかった場合は最後に見た seq が入る
+inline bool ics_shm_read_state(const IcsShmState *st, IcsShmStateValue *val,
+                               uint32_t *seq = nullptr,
+                               int tries = ICS_SHM_READ_TRIES) {
+  for (int a = 0; a < tries; a++) {
+    uint32_t s1 = st->seq.load(std::memory_order_acquire);
+    if (seq != nullptr) {
+      *seq = s1;
+    }
+    if (s1 & 1) {
+      continue;
+    }
+    IcsShmStateValue v;
+    v.position = st->position.load(std::memory_order_relaxed);
+    v.current = st->current.load(std::memory_order_relaxed);
+    v.temperature = st->temperature.load(std::memory_order_relaxed);
+    v.okCount = st->okCount.load(std::memory_order_relaxed);
+    v.errorCount = st->errorCount.load(std::memory_order_relaxed);
+    v.updateTime = st->updateTime.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t s2 = st->seq.load(std::memory_order_relaxed);
+    if (s1 == s2) {
+      *val = v;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 指令の書き込み（クライアント用）
+inline void ics_shm_write_command(IcsShmCommand *cmd, int32_t mode,
+                                  int32_t target) {
+  uint32_t seq = cmd->seq.load(std::memory_order_relaxed);
+  for (;;) {
+    if (((seq & 1) == 0) &&
+        cmd->seq.compare_exchange_weak(seq, seq + 1,
+                                       std::memory_order_acquire,
+                                       std::memory_order_relaxed)) {
+      break;
+    }
+    seq = cmd->seq.load(std::memory_order_relaxed);
+  }
+
+  cmd->mode.store(mode, std::memory_order_relaxed);
+  cmd->target.store(target, std::memory_order_relaxed);
+
+  cmd->seq.store(seq + 2, std::memory_order_release);
+}
+
+// 指令の読み出し（サーバ用）
+// 書き込み中なら tries 回まで読み直す。
+// 戻り値に読めたら true。*seq に最後に見た seq が入る（読めなかった場合は奇数）
+inline bool ics_shm_read_command(const IcsShmCommand *cmd, int32_t *mode,
+                                 int32_t *target, uint32_t *seq,
+                                 int tries = ICS_SHM_READ_TRIES) {
+  for (int a = 0; a < tries; a++) {
+    uint32_t s1 = cmd->seq.load(std::memory_order_acquire);
+    *seq = s1;
+    if (s1 & 1) {
+      continue;
+    }
+    int32_t m = cmd->mode.load(std::memory_order_relaxed);
+    int32_t t = cmd->target.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint32_t s2 = cmd->seq.load(std::memory_order_relaxed);
+    if (s1 == s2) {
+      *mode = m;
+      *target = t;
+      return true;
+    }
+  }
+  return false;
+}
+
+// 書き込み途中で止まった指令の回復（サーバ用）
+// seq がまだ stuckseq（奇数）なら、mode/target を書き戻して偶数に戻す。
+// 戻り値に回復したら true
+inline bool ics_shm_recover_command(IcsShmCommand *cmd, uint32_t stuckseq,
+                                    int32_t mode, int32_t target) {
+  // 止まったクライアントの代わりに、サーバが書き込み権を取る（奇数のまま進める）
+  if (!cmd->seq.compare_exchange_strong(stuckseq, stuckseq + 2,
+                                        std::memory_order_acquire,
+                                        std::memory_order_relaxed)) {
+    return false;
+  }
+  cmd->mode.store(mode, std::memory_order_relaxed);
+  cmd->target.store(target, std::memory_order_relaxed);
+  cmd->seq.store(stuckseq + 3, std::memory_order_release);
+  return true;
+}
+
+#endif
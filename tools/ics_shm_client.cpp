@@ -0,0 +1,101 @@
+// ICSサーボサーバ（ics_shm_server）の確認用クライアント　Linux用
+// 共有メモリ表を直接読み書きする。自作プロセスから使う場合の例も兼ねる。
+//
+// ビルド例（リポジトリ直下で）:
+//   g++ -O2 -Isrc -Itools tools/ics_shm_client.cpp -o ics_shm_client -lrt
+// 実行:
+//   ./ics_shm_client [-n 共有メモリ名] show        全IDの状態を表示
+//   ./ics_shm_client [-n 共有メモリ名] set ID 位置  目標位置を指令
+//   ./ics_shm_client [-n 共有メモリ名] free ID     脱力
+//   ./ics_shm_client [-n 共有メモリ名] none ID     指令なし（位置読み取りのみ）
+
+#include "ics_shm.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+  printf("usage: ics_shm_client [-n shm_name] show | set ID POS | free ID | "
+         "none ID\r\n");
+}
+
+static void show(IcsShmTable *table) {
+  // サーバが動いていれば、指令の書き込み途中判定の時間内に heartbeat が進む
+  uint32_t hb = table->heartbeat.load(std::memory_order_acquire);
+  usleep(ICS_SHM_STUCK_US);
+  uint32_t hb2 = table->heartbeat.load(std::memory_order_acquire);
+  printf("baudrate %u, loop %u us, heartbeat %u%s\r\n", table->baudrate,
+         table->loopUs.load(std::memory_order_relaxed), hb2,
+         (hb2 == hb) ? " (server stopped, values are stale)" : "");
+  uint32_t present = table->presentMask.load(std::memory_order_relaxed);
+  uint32_t v36 = table->v36Mask.load(std::memory_order_relaxed);
+  printf("ID  ICS  position current temperature       ok    error\r\n");
+  for (int id = 0; id < ID_NUM; id++) {
+    if (((table->idmask >> id) & 1) == 0) {
+      continue;
+    }
+    IcsShmStateValue val;
+    const char *ver = ((present >> id) & 1) ? (((v36 >> id) & 1) ? "3.6" : "3.5")
+                                            : "-";
+    if (!ics_shm_read_state(&table->state[id], &val)) {
+      // 書き込み途中のまま（サーバが書き込み中に止まった）
+      printf("%2d  %3s  (unreadable: server stopped while writing)\r\n", id,
+             ver);
+      continue;
+    }
+    printf("%2d  %3s  %8d %7d %11d %8u %8u\r\n", id, ver, val.position,
+           val.current, val.temperature, val.okCount, val.errorCount);
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *name = ICS_SHM_NAME_DEFAULT;
+  int arg = 1;
+
+  if ((argc > 2) && (strcmp(argv[1], "-n") == 0)) {
+    name = argv[2];
+    arg = 3;
+  }
+  if (arg >= argc) {
+    usage();
+    return 1;
+  }
+
+  IcsShmTable *table = ics_shm_open(name, false);
+  if (table == nullptr) {
+    printf("cannot open shared memory %s (server not running?)\r\n", name);
+    return 1;
+  }
+
+  const char *cmd = argv[arg];
+  if (strcmp(cmd, "show") == 0) {
+    show(table);
+  } else if ((arg + 1 < argc) &&
+             ((strcmp(cmd, "set") == 0) || (strcmp(cmd, "free") == 0) ||
+              (strcmp(cmd, "none") == 0))) {
+    int id = atoi(argv[arg + 1]);
+    if ((id < ID_MIN) || (id > ID_MAX)) {
+      usage();
+      return 1;
+    }
+    if (strcmp(cmd, "set") == 0) {
+      if (arg + 2 >= argc) {
+        usage();
+        return 1;
+      }
+      ics_shm_write_command(&table->command[id], ICS_SHM_MODE_POSITION,
+                            atoi(argv[arg + 2]));
+    } else if (strcmp(cmd, "free") == 0) {
+      ics_shm_write_command(&table->command[id], ICS_SHM_MODE_FREE, 0);
+    } else {
+      ics_shm_write_command(&table->command[id], ICS_SHM_MODE_NONE, 0);
+    }
+  } else {
+    usage();
+    return 1;
+  }
+
+  ics_shm_close(table);
+  return 0;
+}
@@ -0,0 +1,478 @@
+// ICSサーボサーバ　Linux用
+// シリアルポート（ICSバス）を占有し、共有メモリ表（tools/ics_shm.hpp）を通して
+// 複数のプロセスにサーボを使わせる。ループは待ち無しで回し、1周で
+//  ・通信対象の全IDに、指令に応じた1往復（移動・脱力・ICS3.6位置読み取り）
+//  ・追加で1往復、1つのIDの電流か温度を順番に読む
+// を行い、結果を表に書き込む。
+// 起動時に各IDのICSバージョンを調べ、返信の無いIDはループから外す
+// （返信の無いIDは1往復ごとにタイムアウトまで待つため）。外したIDは
+// PROBE_INTERVAL_US ごとに1つずつ再確認し、返信があればループに戻す。
+// 通信中のIDも ERROR_LIMIT 回続けて失敗したら外す。
+// 指令なし（ICS_SHM_MODE_NONE）の3.5サーボとは通信しない。
+// フレームの作成・解釈はライブラリと同じ IcsCodec を使う。
+// （IcsCommunication は mbed の UnbufferedSerial / DigitalOut 前提なので、
+// 送受信部分のみ termios で実装している）
+//
+// ビルド例（リポジトリ直下で）:
+//   g++ -O2 -Isrc -Itools tools/ics_shm_server.cpp src/IcsCodec.cpp src/IcsBusPlanner.cpp -o ics_shm_server -lrt
+// 実行:
+//   ./ics_shm_server [-b ボーレート] [-i ID範囲 例 0-5,8] [-n 共有メモリ名]
+//                    [-e] [-r 優先度] /dev/ttyUSB0
+//   -e: 送信データが受信側に折り返されるアダプタ（1線式）の場合に指定
+//   -r: SCHED_FIFO の優先度（root権限が必要）
+
+#include "IcsCodec.hpp"
+#include "ics_shm.hpp"
+
+#include <asm/termbits.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+
+// 返信待ちタイムアウト（最後に受信してからの時間, usec）
+static const int TIMEOUT_US = 10000;
+// 返信の無いIDの再確認の間隔、ループから外すまでの連続失敗回数
+static const uint32_t PROBE_INTERVAL_US = 1000000;
+static const int ERROR_LIMIT = 10;
+// 3.5と判定するのに必要な、3.6コマンド無応答 + 3.5コマンド応答の連続回数
+static const int PROBE35_CONFIRM = 3;
+
+// IDごとのバージョン
+static const int VER_ABSENT = 0;
+static const int VER_35 = 35;
+static const int VER_36 = 36;
+
+static volatile sig_atomic_t quit = 0;
+
+static void on_signal(int) { quit = 1; }
+
+static uint32_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)(ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+}
+
+// シリアルポートを開く　8bit, EVEN, 1stop、任意ボーレート（termios2）
+static int open_serial(const char *dev, uint32_t baud) {
+  int fd = open(dev, O_RDWR | O_NOCTTY);
+  if (fd < 0) {
+    return -1;
+  }
+
+  struct termios2 tio;
+  if (ioctl(fd, TCGETS2, &tio) != 0) {
+    close(fd);
+    return -1;
+  }
+  tio.c_iflag = 0;
+  tio.c_oflag = 0;
+  tio.c_lflag = 0;
+  tio.c_cflag = CS8 | PARENB | CLOCAL | CREAD | BOTHER;
+  tio.c_ispeed = baud;
+  tio.c_ospeed = baud;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  if (ioctl(fd, TCSETS2, &tio) != 0) {
+    close(fd);
+    return -1;
+  }
+  ioctl(fd, TCFLSH, TCIOFLUSH);
+  return fd;
+}
+
+// バス1本分の送受信
+struct Bus
+{
+  int fd;
+  bool echo;
+  int rxCount; // 直前の往復で受信できたバイト数
+};
+
+// 指定バイト数を受信　最後に受信してから TIMEOUT_US 返信が無ければ打ち切り
+// 戻り値に受信できたバイト数
+static int read_bytes(int fd, uint8_t *buf, int size) {
+  int len = 0;
+  while (len < size) {
+    struct pollfd pfd = {fd, POLLIN, 0};
+    struct timespec ts = {0, TIMEOUT_US * 1000L};
+    if (ppoll(&pfd, 1, &ts, nullptr) <= 0) {
+      break;
+    }
+    ssize_t n = read(fd, buf + len, size - len);
+    if (n <= 0) {
+      break;
+    }
+    len += n;
+  }
+  return len;
+}
+
+// IcsCommunication::transceive と同じ戻り値
+static int transceive(Bus *bus, uint8_t *txbuf, uint8_t *rxbuf, int txsize,
+                      int rxsize) {
+  ioctl(bus->fd, TCFLSH, TCIFLUSH);
+  bus->rxCount = 0;
+  if (write(bus->fd, txbuf, txsize) != txsize) {
+    return RETCODE_ERROR_ICSREAD;
+  }
+  // 最後のストップビットまで送信完了を待つ
+  ioctl(bus->fd, TCSBRK, 1);
+
+  // 1線式アダプタの折り返しを捨てる
+  if (bus->echo) {
+    uint8_t tmp[ICS_EEPROM_SIZE];
+    if (read_bytes(bus->fd, tmp, txsize) != txsize) {
+      return RETCODE_ERROR_ICSREAD;
+    }
+  }
+
+  bus->rxCount = read_bytes(bus->fd, rxbuf, rxsize);
+  if (bus->rxCount != rxsize) {
+    return RETCODE_ERROR_ICSWRITE;
+  }
+  return RETCODE_OK;
+}
+
+// ICS3.6の位置読み取り　戻り値に現在位置、またはエラーコード（負の値）
+static int servo_read_position(Bus *bus, uint8_t id) {
+  uint8_t tx[2], rx[4];
+  ics_encode_read_param(tx, id, ICS_SC_POSITION);
+  int ret = transceive(bus, tx, rx, 2, 4);
+  if (ret != RETCODE_OK) {
+    return ret;
+  }
+  return ics_decode_read_position(rx, id);
+}
+
+// 指令に応じた1往復　戻り値に現在位置、またはエラーコード（負の値）
+static int servo_command(Bus *bus, uint8_t id, int32_t mode, int32_t target) {
+  uint8_t tx[3], rx[3];
+
+  if (mode == ICS_SHM_MODE_NONE) {
+    // 移動指令なし　ICS3.6の位置読み取り（3.5はここを呼ばない）
+    return servo_read_position(bus, id);
+  }
+
+  // 脱力はポジション 0
+  int val = (mode == ICS_SHM_MODE_FREE) ? 0 : target;
+  if ((mode == ICS_SHM_MODE_POSITION) &&
+      ((target < POS_MIN) || (target > POS_MAX))) {
+    return RETCODE_ERROR_OPTIONWRONG;
+  }
+  ics_encode_position(tx, id, val);
+  int ret = transceive(bus, tx, rx, 3, 3);
+  if (ret != RETCODE_OK) {
+    return ret;
+  }
+  return ics_decode_position(rx, id);
+}
+
+// パラメータ読み取り　戻り値に値、またはエラーコード（負の値）
+static int servo_read_param(Bus *bus, uint8_t id, uint8_t sccode) {
+  uint8_t tx[2], rx[3];
+  ics_encode_read_param(tx, id, sccode);
+  int ret = transceive(bus, tx, rx, 2, 3);
+  if (ret != RETCODE_OK) {
+    return ret;
+  }
+  return ics_decode_read_param(rx, id, sccode);
+}
+
+// バージョン検出（IcsCommunication::get_icsversion と同じ手順）
+// 3.6の位置読み取りに全く返信が無く、ストレッチ読み取りには応答する結果が
+// PROBE35_CONFIRM 回続いたときだけ3.5とする。
+// 戻り値に VER_36, VER_35, VER_ABSENT（返信なし・判別不能）
+static int probe_version(Bus *bus, uint8_t id) {
+  for (int a = 0; a < PROBE35_CONFIRM; a++) {
+    if (servo_read_position(bus, id) >= 0) {
+      return VER_36;
+    }
+    if (bus->rxCount != 0) {
+      return VER_ABSENT;
+    }
+    if (servo_read_param(bus, id, ICS_SC_STRETCH) < 0) {
+      return VER_ABSENT;
+    }
+  }
+  return VER_35;
+}
+
+// 検出結果を表に反映
+static void publish_versions(IcsShmTable *table, const int *ver) {
+  uint32_t present = 0;
+  uint32_t v36 = 0;
+  for (int id = 0; id < ID_NUM; id++) {
+    if (ver[id] != VER_ABSENT) {
+      present |= 1UL << id;
+    }
+    if (ver[id] == VER_36) {
+      v36 |= 1UL << id;
+    }
+  }
+  table->presentMask.store(present, std::memory_order_relaxed);
+  table->v36Mask.store(v36, std::memory_order_relaxed);
+}
+
+// 往復結果の記録　続けて ERROR_LIMIT 回失敗したIDはループから外す
+static void count_result(IcsShmTable *table, int *ver, int *errrun, int id,
+                         bool ok) {
+  if (ok) {
+    errrun[id] = 0;
+    return;
+  }
+  if (++errrun[id] >= ERROR_LIMIT) {
+    printf("ID %d: no reply, removed from loop\r\n", id);
+    ver[id] = VER_ABSENT;
+    errrun[id] = 0;
+    publish_versions(table, ver);
+  }
+}
+
+// ID範囲の解釈　例 "0-5,8"
+static uint32_t parse_ids(const char *s) {
+  uint32_t mask = 0;
+  while (*s) {
+    char *end;
+    long a = strtol(s, &end, 10);
+    long b = a;
+    if (*end == '-') {
+      b = strtol(end + 1, &end, 10);
+    }
+    for (long id = a; id <= b; id++) {
+      if ((id >= ID_MIN) && (id <= ID_MAX)) {
+        mask |= 1UL << id;
+      }
+    }
+    s = (*end == ',') ? end + 1 : end;
+    if (end == s) {
+      break;
+    }
+  }
+  return mask;
+}
+
+static void usage() {
+  printf("usage: ics_shm_server [-b baud] [-i ids] [-n shm_name] [-e] "
+         "[-r rt_prio] device\r\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t baud = 115200;
+  uint32_t idmask = 0xFFFFFFFF;
+  const char *name = ICS_SHM_NAME_DEFAULT;
+  bool echo = false;
+  int rtprio = 0;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:i:n:er:")) != -1) {
+    switch (opt) {
+    case 'b':
+      baud = atol(optarg);
+      break;
+    case 'i':
+      idmask = parse_ids(optarg);
+      break;
+    case 'n':
+      name = optarg;
+      break;
+    case 'e':
+      echo = true;
+      break;
+    case 'r':
+      rtprio = atoi(optarg);
+      break;
+    default:
+      usage();
+      return 1;
+    }
+  }
+  if ((optind >= argc) || (idmask == 0)) {
+    usage();
+    return 1;
+  }
+
+  Bus bus;
+  bus.echo = echo;
+  bus.fd = open_serial(argv[optind], baud);
+  if (bus.fd < 0) {
+    printf("cannot open %s: %s\r\n", argv[optind], strerror(errno));
+    return 1;
+  }
+
+  IcsShmTable *table = ics_shm_open(name, true);
+  if (table == nullptr) {
+    printf("cannot create shared memory %s: %s\r\n", name, strerror(errno));
+    return 1;
+  }
+  memset((void *)table, 0, sizeof(IcsShmTable));
+  for (int id = 0; id < ID_NUM; id++) {
+    IcsShmStateValue val = {-1, -1, -1, 0, 0, 0};
+    ics_shm_publish(&table->state[id], &val);
+  }
+  table->idmask = idmask;
+  table->baudrate = baud;
+  table->version = ICS_SHM_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  table->magic = ICS_SHM_MAGIC; // 最後に書いて、初期化完了をクライアントに示す
+
+  // リアルタイム優先度（任意）　ページフォルトで止まらないようメモリも固定
+  if (rtprio > 0) {
+    struct sched_param sp;
+    sp.sched_priority = rtprio;
+    if ((sched_setscheduler(0, SCHED_FIFO, &sp) != 0) ||
+        (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)) {
+      printf("warning: real-time setup failed: %s\r\n", strerror(errno));
+    }
+  }
+
+  signal(SIGINT, on_signal);
+  signal(SIGTERM, on_signal);
+
+  // サーバ内の状態（表へはまとめて書く）
+  IcsShmStateValue state[ID_NUM];
+  for (int id = 0; id < ID_NUM; id++) {
+    state[id] = {-1, -1, -1, 0, 0, 0};
+  }
+  // 前回読めた指令　書き込み中で読めなかった周は、これを使う
+  int32_t lastMode[ID_NUM] = {};
+  int32_t lastTarget[ID_NUM] = {};
+  uint32_t stuckSeq[ID_NUM] = {}; // 奇数のまま読めなかった seq（0 はなし）
+  uint32_t stuckSince[ID_NUM] = {};
+  int sideIndex = 0;
+  bool sideCurrent = true;
+
+  // 起動時のバージョン検出　返信の無いIDはループに入れない
+  int ver[ID_NUM] = {};
+  int errRun[ID_NUM] = {};
+  for (int id = 0; id < ID_NUM; id++) {
+    if ((idmask >> id) & 1) {
+      ver[id] = probe_version(&bus, id);
+      if (ver[id] != VER_ABSENT) {
+        printf("ID %d: ICS %s\r\n", id, (ver[id] == VER_36) ? "3.6" : "3.5");
+      }
+    }
+  }
+  publish_versions(table, ver);
+  int probeIndex = 0;
+  uint32_t probeTime = now_us();
+  uint32_t lasttime = now_us();
+
+  while (!quit) {
+    for (int id = 0; id < ID_NUM; id++) {
+      if (((idmask >> id) & 1) == 0) {
+        continue;
+      }
+      int32_t mode, target;
+      uint32_t seq;
+      IcsShmCommand *cmd = &table->command[id];
+      if (ics_shm_read_command(cmd, &mode, &target, &seq)) {
+        lastMode[id] = mode;
+        lastTarget[id] = target;
+        stuckSeq[id] = 0;
+      } else {
+        // 書き込み中　前回の指令を使い、同じ seq のまま続くなら回復させる
+        mode = lastMode[id];
+        target = lastTarget[id];
+        if (stuckSeq[id] != seq) {
+          stuckSeq[id] = seq;
+          stuckSince[id] = now_us();
+        } else if ((uint32_t)(now_us() - stuckSince[id]) >= ICS_SHM_STUCK_US) {
+          if (ics_shm_recover_command(cmd, seq, mode, target)) {
+            printf("ID %d: recovered stale command (seq %u)\r\n", id, seq);
+          }
+          stuckSeq[id] = 0;
+        }
+      }
+
+      if (ver[id] == VER_ABSENT) {
+        continue;
+      }
+      if ((mode == ICS_SHM_MODE_NONE) && (ver[id] == VER_35)) {
+        // 3.5には脱力させずに位置を読むコマンドが無いので、通信しない
+        continue;
+      }
+
+      IcsShmStateValue *st = &state[id];
+      int pos = servo_command(&bus, id, mode, target);
+      if (pos >= 0) {
+        st->position = pos;
+        st->okCount++;
+      } else {
+        st->errorCount++;
+      }
+      count_result(table, ver, errRun, id, pos >= 0);
+      st->updateTime = now_us();
+      ics_shm_publish(&table->state[id], st);
+    }
+
+    // 追加の1往復　電流と温度を交互に、IDを順番に
+    for (int n = 0; n < ID_NUM; n++) {
+      int id = (sideIndex + n) % ID_NUM;
+      if (ver[id] == VER_ABSENT) {
+        continue;
+      }
+      IcsShmStateValue *st = &state[id];
+      int val = servo_read_param(
+          &bus, id, sideCurrent ? ICS_SC_CURRENT : ICS_SC_TEMPERATURE);
+      if (val >= 0) {
+        if (sideCurrent) {
+          st->current = val;
+        } else {
+          st->temperature = val;
+        }
+        st->okCount++;
+      } else {
+        st->errorCount++;
+      }
+      count_result(table, ver, errRun, id, val >= 0);
+      st->updateTime = now_us();
+      ics_shm_publish(&table->state[id], st);
+
+      // 電流・温度の両方を読んだら次のIDへ
+      if (!sideCurrent) {
+        sideIndex = (id + 1) % ID_NUM;
+      } else {
+        sideIndex = id;
+      }
+      sideCurrent = !sideCurrent;
+      break;
+    }
+
+    // 外したIDの再確認　PROBE_INTERVAL_US ごとに1つだけ
+    if ((uint32_t)(now_us() - probeTime) >= PROBE_INTERVAL_US) {
+      probeTime = now_us();
+      for (int n = 0; n < ID_NUM; n++) {
+        int id = (probeIndex + n) % ID_NUM;
+        if ((((idmask >> id) & 1) == 0) || (ver[id] != VER_ABSENT)) {
+          continue;
+        }
+        ver[id] = probe_version(&bus, id);
+        if (ver[id] != VER_ABSENT) {
+          printf("ID %d: ICS %s, added to loop\r\n", id,
+                 (ver[id] == VER_36) ? "3.6" : "3.5");
+          publish_versions(table, ver);
+        }
+        probeIndex = (id + 1) % ID_NUM;
+        break;
+      }
+    }
+
+    uint32_t now = now_us();
+    table->loopUs.store(now - lasttime, std::memory_order_relaxed);
+    table->heartbeat.fetch_add(1, std::memory_order_release);
+    lasttime = now;
+  }
+
+  // 終了時は表を消す（クライアントはサーバ停止を heartbeat か open 失敗で知る）
+  ics_shm_close(table);
+  shm_unlink(name);
+  close(bus.fd);
+  return 0;
+}
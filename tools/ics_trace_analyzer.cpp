@@ -0,0 +1,309 @@
+// ICSバス通信記録（IcsTrace）の解析ツール　Linux用
+// トレースファイルを mmap で読み込み、全フレームをライブラリと同じ
+// IcsCodec で解釈して、以下を表示する。
+//  ・IDごとの往復時間（レイテンシ）分布、エラー率
+//  ・コマンド種別ごとの件数
+//  ・バス使用率、フレーム間の空き時間
+//
+// ビルド例（リポジトリ直下で）:
+//   g++ -O2 -Isrc tools/ics_trace_analyzer.cpp src/IcsCodec.cpp
+//       src/IcsBusPlanner.cpp -o ics_trace_analyzer
+// 実行:
+//   ./ics_trace_analyzer trace.bin
+
+#include "IcsBusPlanner.hpp"
+#include "IcsCodec.hpp"
+#include "IcsTrace.hpp"
+#include "IcsVarint.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 時間分布のヒストグラム　BUCKET_US 刻み、最後のビンはそれ以上全部
+static const int BUCKET_US = 5;
+static const int BUCKET_NUM = 2000;
+
+// ID -1（全体宛て）は最後の添字に入れる
+static const int STAT_NUM = ID_NUM + 1;
+static const int RESULT_NUM = 16;
+
+struct Histogram
+{
+  uint64_t bucket[BUCKET_NUM];
+  uint64_t count;
+  uint64_t sum;
+  uint32_t min;
+  uint32_t max;
+};
+
+struct IdStat
+{
+  Histogram latency;
+  uint64_t result[RESULT_NUM]; // 結果コード別件数（0 = OK）
+  uint64_t replywrong;         // 受信はできたが内容がおかしい
+  uint64_t cmd[ICS_CMD_NUM + 1];
+};
+
+static IdStat idstat[STAT_NUM];
+static Histogram gapstat;
+
+static void hist_add(Histogram *h, uint32_t us) {
+  int b = us / BUCKET_US;
+  if (b >= BUCKET_NUM) {
+    b = BUCKET_NUM - 1;
+  }
+  h->bucket[b]++;
+  if ((h->count == 0) || (us < h->min)) {
+    h->min = us;
+  }
+  if (us > h->max) {
+    h->max = us;
+  }
+  h->count++;
+  h->sum += us;
+}
+
+// パーセンタイル（ビンの上端で返す）
+static uint32_t hist_percentile(const Histogram *h, int percent) {
+  uint64_t target = (h->count * percent + 99) / 100;
+  uint64_t acc = 0;
+  for (int a = 0; a < BUCKET_NUM; a++) {
+    acc += h->bucket[a];
+    if (acc >= target) {
+      uint32_t upper = (a + 1) * BUCKET_US;
+      return (upper < h->max) ? upper : h->max;
+    }
+  }
+  return h->max;
+}
+
+// 返信内容がライブラリの解釈で正しいか
+static bool reply_valid(const IcsFrameInfo *info, const uint8_t *rx,
+                        int rxcount) {
+  switch (info->cmd) {
+  case ICS_CMD_POSITION:
+    return (rxcount == 3) && (ics_decode_position(rx, info->id) >= 0);
+  case ICS_CMD_READPARAM:
+    return (rxcount == 3) &&
+           (ics_decode_read_param(rx, info->id, info->sc) >= 0);
+  case ICS_CMD_WRITEPARAM:
+    return (rxcount == 3) &&
+           (ics_decode_write_param(rx, info->id, info->sc) >= 0);
+  case ICS_CMD_READPOSITION:
+    return (rxcount == 4) && (ics_decode_read_position(rx, info->id) >= 0);
+  case ICS_CMD_READEEPROM:
+    return (rxcount == ICS_EEPROM_SIZE) &&
+           (ics_check_EEPROM_header(rx, info->id) == RETCODE_OK);
+  case ICS_CMD_WRITEEEPROM:
+    return (rxcount == 2) && (rx[0] == (0x40 | info->id)) &&
+           (rx[1] == ICS_SC_EEPROM);
+  case ICS_CMD_ID:
+    return (rxcount >= 1) && ((rx[0] >> 5) == 0b00000111);
+  default:
+    return false;
+  }
+}
+
+static const char *cmd_name(int cmd) {
+  static const char *names[ICS_CMD_NUM + 1] = {
+      "position", "readparam", "writeparam", "readeeprom",
+      "writeeeprom", "readposition", "id", "unknown"};
+  return names[cmd];
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    fprintf(stderr, "usage: %s trace.bin\n", argv[0]);
+    return 1;
+  }
+
+  int fd = open(argv[1], O_RDONLY);
+  if (fd < 0) {
+    perror("open");
+    return 1;
+  }
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+    fprintf(stderr, "empty or unreadable file\n");
+    return 1;
+  }
+  size_t size = st.st_size;
+  const uint8_t *buf =
+      (const uint8_t *)mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (buf == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  madvise((void *)buf, size, MADV_SEQUENTIAL);
+
+  IcsBusPlanner planner;
+  uint32_t charns = 0;
+  uint64_t now = 0;       // 64bitに伸ばした現在記録の開始時刻
+  uint64_t firsttime = 0; // 最初のメタ記録の時刻
+  uint64_t lastend = 0;   // 前のトランザクションの終了時刻
+  bool havemeta = false;
+  bool havelast = false;
+  uint64_t wirens = 0;
+  uint64_t transactions = 0;
+  uint64_t resync = 0;
+  uint32_t dropped = 0;
+
+  size_t pos = 0;
+  while (pos < size) {
+    uint8_t tag = buf[pos];
+    const uint8_t *p = &buf[pos + 1];
+    int rest = (size - pos - 1 > 0x7FFFFFFF) ? 0x7FFFFFFF : (size - pos - 1);
+    int len;
+    uint32_t val;
+
+    if (tag == ICS_TRACE_TAG_META) {
+      uint32_t brate;
+      if (rest < 4) {
+        break;
+      }
+      uint32_t abs =
+          p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+      int off = 4;
+      if ((len = ics_varint_decode(&p[off], rest - off, &brate)) == 0) {
+        break;
+      }
+      off += len;
+      if ((len = ics_varint_decode(&p[off], rest - off, &dropped)) == 0) {
+        break;
+      }
+      off += len;
+
+      // 32bit時刻を、直前の時刻に近い64bit値に伸ばす
+      if (!havemeta) {
+        now = abs;
+        firsttime = now;
+      } else {
+        now += (uint32_t)(abs - (uint32_t)now);
+      }
+      havemeta = true;
+      havelast = false; // 記録が抜けている可能性があるので空き時間は数えない
+      planner.set_baudrate(brate);
+      charns = planner.char_ns();
+      pos += 1 + off;
+      continue;
+    }
+
+    if ((tag != ICS_TRACE_TAG_TRANSACTION) || !havemeta) {
+      // 同期が外れている　1バイトずつ進めて次のタグを探す
+      resync++;
+      pos++;
+      continue;
+    }
+
+    int off = 0;
+    if ((len = ics_varint_decode(&p[off], rest - off, &val)) == 0) {
+      break;
+    }
+    off += len;
+    if (rest - off < 4) {
+      break;
+    }
+    uint8_t txsize = p[off++];
+    off++; // 受信要求サイズ（受信できたサイズがあれば解析には不要）
+    uint8_t rxcount = p[off++];
+    uint8_t result = p[off++];
+    uint32_t txdone, duration;
+    if ((len = ics_varint_decode(&p[off], rest - off, &txdone)) == 0) {
+      break;
+    }
+    off += len;
+    if ((len = ics_varint_decode(&p[off], rest - off, &duration)) == 0) {
+      break;
+    }
+    off += len;
+    if (rest - off < txsize + rxcount) {
+      break;
+    }
+    const uint8_t *tx = &p[off];
+    const uint8_t *rx = &p[off + txsize];
+    off += txsize + rxcount;
+
+    now += val;
+    if (havelast && (now >= lastend)) {
+      hist_add(&gapstat, (uint32_t)(now - lastend));
+    }
+    lastend = now + duration;
+    havelast = true;
+
+    IcsFrameInfo info;
+    ics_decode_frame(tx, txsize, &info);
+    IdStat *ids = &idstat[(info.id >= 0) ? info.id : ID_NUM];
+
+    hist_add(&ids->latency, duration);
+    ids->cmd[info.cmd]++;
+    ids->result[(result < RESULT_NUM) ? result : RESULT_NUM - 1]++;
+    if ((result == 0) && !reply_valid(&info, rx, rxcount)) {
+      ids->replywrong++;
+    }
+
+    wirens += (uint64_t)charns * (txsize + rxcount);
+    transactions++;
+    pos += 1 + off;
+  }
+
+  munmap((void *)buf, size);
+  close(fd);
+
+  if (pos < size) {
+    printf("warning: truncated record at offset %zu\n", pos);
+  }
+
+  uint64_t elapsed = (lastend > firsttime) ? (lastend - firsttime) : 0;
+  printf("transactions: %llu, elapsed: %.3f s, dropped(recorder): %u, "
+         "resync bytes: %llu\n",
+         (unsigned long long)transactions, elapsed / 1e6, dropped,
+         (unsigned long long)resync);
+  if (elapsed > 0) {
+    printf("bus utilisation: %.2f %%\n", wirens / 10.0 / elapsed);
+  }
+  if (gapstat.count > 0) {
+    printf("inter-frame gap [us]: min %u avg %.1f p50 %u p99 %u max %u\n",
+           gapstat.min, (double)gapstat.sum / gapstat.count,
+           hist_percentile(&gapstat, 50), hist_percentile(&gapstat, 99),
+           gapstat.max);
+  }
+
+  printf("\n  ID      count   err%%  wrong   min   avg   p50   p90   p99   max"
+         "  commands\n");
+  for (int a = 0; a < STAT_NUM; a++) {
+    IdStat *ids = &idstat[a];
+    Histogram *h = &ids->latency;
+    if (h->count == 0) {
+      continue;
+    }
+    uint64_t errors = h->count - ids->result[0];
+    if (a < ID_NUM) {
+      printf("  %2d", a);
+    } else {
+      printf(" all");
+    }
+    printf(" %10llu %6.2f %6llu %5u %5.0f %5u %5u %5u %5u ",
+           (unsigned long long)h->count, errors * 100.0 / h->count,
+           (unsigned long long)ids->replywrong, h->min,
+           (double)h->sum / h->count, hist_percentile(h, 50),
+           hist_percentile(h, 90), hist_percentile(h, 99), h->max);
+    for (int c = 0; c <= ICS_CMD_NUM; c++) {
+      if (ids->cmd[c] > 0) {
+        printf(" %s:%llu", cmd_name(c), (unsigned long long)ids->cmd[c]);
+      }
+    }
+    printf("\n");
+    for (int r = 1; r < RESULT_NUM; r++) {
+      if (ids->result[r] > 0) {
+        printf("       error %d: %llu\n", ics_trace_result_decode(r),
+               (unsigned long long)ids->result[r]);
+      }
+    }
+  }
+
+  return 0;
+}